@@ -2,12 +2,14 @@
 rm -r plots/bdays/
 mkdir plots/bdays/
 for file in ./datasets/B-days/*.csv; do
+    # Outputs of an earlier run are not station files
+    [[ "$file" == *_points.csv ]] && continue
     city=$(basename "$file" .csv)
     echo "Analyzing $city..."
 
     out_file="./datasets/B-days/${city}_points.csv"
 
-    ./build/b-days "$file" "$out_file"
+    ./build/b-days "$file" "$out_file" --dates 11-06,03-11,04-12 --hours 10-15
     root -l -b -q "./src/plot_bdays.C(\"$out_file\", \"$city\")"
 done
 
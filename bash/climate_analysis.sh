@@ -4,11 +4,9 @@ rm -r plots/max_min_temps
 mkdir -p plots/mean_temps
 mkdir -p plots/max_min_temps
 
-for file in ./datasets/Climate/*.root; do
-    city=$(basename "$file" .root)
-    echo "Analyzing $city..."
-    root -l -b -q "./src/plot_mean_temp_trend.C(\"$file\", \"$city\")"
-    root -l -b -q "./src/plot_max_min_trends.C(\"$file\", \"$city\")"
-done
+# One process draws the mean and max/min trend plots of every city in
+# datasets/Climate, opening each ROOT file once; the cities are spread over
+# one worker process per core.
+./build/plot_climate -j "$(nproc)"
 
 echo "All plots saved in plots/"
@@ -1,49 +1,8 @@
 #!/bin/bash
 
-# Loop over all CSV files in the current directory
-for csv_file in ./datasets/B-days/*.csv; do
-    # Skip if no CSV files exist
-    [ -e "$csv_file" ] || continue
+# Convert every CSV in the dataset folders to a ROOT file with the same base
+# name. One csv_to_root process handles all of them with a pool of worker
+# threads, instead of paying ROOT start-up once per file.
+./build/csv_to_root --mmap ./datasets/B-days ./datasets/Climate ./datasets/Solar
 
-    # Extract filename without extension
-    filename=$(basename "$csv_file" .csv)
-    
-    # Output ROOT file will have the same base name
-    root_file="./datasets/B-days/${filename}.root"
-    
-    # Run the converter
-    ./build/csv_to_root "$csv_file" "$root_file"
-    
-    echo "Converted $csv_file → $root_file"
-done
-for csv_file in ./datasets/Climate/*.csv; do
-    # Skip if no CSV files exist
-    [ -e "$csv_file" ] || continue
-
-    # Extract filename without extension
-    filename=$(basename "$csv_file" .csv)
-    
-    # Output ROOT file will have the same base name
-    root_file="./datasets/Climate/${filename}.root"
-    
-    # Run the converter
-    ./build/csv_to_root "$csv_file" "$root_file"
-    
-    echo "Converted $csv_file → $root_file"
-done
-for csv_file in ./datasets/Solar/*.csv; do
-    # Skip if no CSV files exist
-    [ -e "$csv_file" ] || continue
-
-    # Extract filename without extension
-    filename=$(basename "$csv_file" .csv)
-    
-    # Output ROOT file will have the same base name
-    root_file="./datasets/Solar/${filename}.root"
-    
-    # Run the converter
-    ./build/csv_to_root "$csv_file" "$root_file"
-    
-    echo "Converted $csv_file → $root_file"
-done
-echo "All files processed."
\ No newline at end of file
+echo "All files processed."
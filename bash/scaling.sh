@@ -0,0 +1,84 @@
+#!/bin/bash
+# End-to-end scaling run of the pipeline on synthetic SMHI data:
+#
+#   ./bash/scaling.sh [STATIONS ...]        default: 10 100 1000
+#
+# For every station count, build/gen_smhi writes that many stations of
+# $YEARS years (default 60) of data to scaling/N/raw, and preprocess.sh and
+# the solar, climate and birthday analyses run over it in scaling/N with
+# FORCE=1 and RAW_DIR pointing there. The source tree is linked in, so the
+# real datasets/ and plots/ are not touched. Each run leaves its stage
+# reports and timeline in scaling/N/reports (see bash/timeline.sh) and adds
+# one line per stage to scaling/summary.csv:
+#   stations;stage;wall_s;rows;bytes;peak_rss_bytes
+# The first count whose run fails stops the sweep; its log is scaling/N/log.
+#
+# Environment: YEARS, GEN_OPTIONS (more build/gen_smhi options),
+# SCALING_DIR (default scaling). Check the disk first with
+#   ./build/gen_smhi --estimate --stations N --years Y
+set -u
+shopt -s nullglob
+
+root=$(pwd)
+dir="${SCALING_DIR:-scaling}"
+years="${YEARS:-60}"
+counts=("$@")
+[ ${#counts[@]} = 0 ] && counts=(10 100 1000)
+
+source ./bash/stage.sh
+mkdir -p build "$dir"
+run_stage build-gen_smhi "src/gen_smhi.cxx include" "build/gen_smhi" \
+    g++ -O2 -pthread -Iinclude src/gen_smhi.cxx -o ./build/gen_smhi || exit 1
+
+summary="$dir/summary.csv"
+echo "stations;stage;wall_s;rows;bytes;peak_rss_bytes" > "$summary"
+
+# The analyses of run_all.sh, without the report
+analyses() {
+    source ./bash/stage.sh
+    run_stage solar "$(stamp clean)" "plots/solar" ./bash/solar_analysis.sh &&
+    run_stage climate-plots "$(stamp csv_to_root)" \
+        "plots/mean_temps plots/max_min_temps" ./bash/climate_analysis.sh &&
+    run_stage bdays "$(stamp clean)" "plots/bdays" ./bash/bdays.sh
+}
+
+for n in "${counts[@]}"; do
+    work="$dir/$n"
+    echo "== $n stations, $years years"
+    rm -rf "$work"
+    mkdir -p "$work/plots"
+    for entry in src include bash rootlogon.C preprocess.sh; do
+        ln -s "$root/$entry" "$work/$entry"
+    done
+
+    # shellcheck disable=SC2086
+    ./build/gen_smhi "$work/raw" --stations "$n" --years "$years" \
+        ${GEN_OPTIONS:-} || exit 1
+
+    (
+        cd "$work" || exit 1
+        export RAW_DIR=raw MNXB_REPORT_DIR=reports FORCE=1
+        ./preprocess.sh && analyses
+    ) > "$work/log" 2>&1
+    status=$?
+    ./bash/timeline.sh "$work/reports"
+
+    # One line per stage of bash/stage.sh, plus the tools' own counters
+    for report in "$work"/reports/*.json; do
+        [ "$report" = "$work/reports/timeline.json" ] && continue
+        sed -n 's/^  "\([a-z_]*\)": "\{0,1\}\([^",]*\)"\{0,1\},\{0,1\}$/\1=\2/p' \
+            "$report" | awk -v n="$n" -F= '
+            { v[$1] = $2 }
+            END {
+                printf "%s;%s;%s;%s;%s;%s\n", n, v["stage"], v["wall_s"],
+                       v["rows"], v["bytes"], v["peak_rss_bytes"]
+            }' >> "$summary"
+    done
+
+    if [ "$status" != 0 ]; then
+        echo "Run with $n stations failed, see $work/log:" >&2
+        tail -n 5 "$work/log" >&2
+        exit 1
+    fi
+done
+echo "Scaling summary written to $summary"
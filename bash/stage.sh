@@ -0,0 +1,107 @@
+#!/bin/bash
+# Content-hashed incremental stages, sourced by preprocess.sh and run_all.sh.
+#
+#   run_stage NAME "DEPS..." "OUTPUTS..." COMMAND [ARGS...]
+#
+# DEPS are files or directories (hashed by content, recursively) that the
+# stage reads: its sources, binary or macro and its input data. Depending on
+# an upstream stage is done by listing its stamp, $(stamp NAME). The stage is
+# skipped if its recorded hash matches and all OUTPUTS still exist, the
+# directories among them not empty; otherwise COMMAND runs and, if it
+# succeeds, the new hash is recorded in .stamps/NAME together with the time
+# of the run. A stage that reran therefore changes its stamp even when its
+# inputs did not, and every stage listing that stamp reruns after it.
+#
+# COMMAND runs in a new bash with errexit (set -e), so a shell function
+# stage fails as soon as one of its commands fails, not only on its last
+# one. The functions of the calling script are passed on, its variables
+# only if they are exported.
+#
+# FORCE=1 ./run_all.sh reruns every stage.
+#
+# The wall time of every stage that ran is written to
+# $MNXB_REPORT_DIR/stage-NAME.json (reports/ by default), next to the
+# reports of the tools themselves, see bash/timeline.sh.
+
+STAMP_DIR="${STAMP_DIR:-.stamps}"
+mkdir -p "$STAMP_DIR"
+REPORT_DIR="${MNXB_REPORT_DIR:-reports}"
+
+stamp() {
+    echo "$STAMP_DIR/$1"
+}
+
+# Hash of the command line and the contents of every dependency
+stage_hash() {
+    local deps="$1"
+    shift
+    {
+        printf '%s\n' "$*"
+        for dep in $deps; do
+            if [ -d "$dep" ]; then
+                find "$dep" -type f -print0 | sort -z | xargs -0 -r sha256sum
+            elif [ -e "$dep" ]; then
+                sha256sum "$dep"
+            else
+                echo "missing $dep"
+            fi
+        done
+    } | sha256sum | cut -d' ' -f1
+}
+
+# Same layout as the reports of include/instrument.h, without counters
+stage_report() {
+    mkdir -p "$REPORT_DIR"
+    local now
+    now=$(date +%s.%N)
+    awk -v name="$1" -v start="$2" -v now="$now" 'BEGIN {
+        printf "{\n  \"stage\": \"stage-%s\",\n", name
+        printf "  \"start_unix\": %.6f,\n", start
+        printf "  \"wall_s\": %.6f,\n", now - start
+        printf "  \"rows\": 0,\n  \"bytes\": 0,\n  \"peak_rss_bytes\": 0,\n"
+        printf "  \"phases\": []\n}\n"
+    }' > "$REPORT_DIR/stage-$1.json"
+}
+
+run_stage() {
+    local name="$1" deps="$2" outputs="$3"
+    shift 3
+
+    local hash
+    hash=$(stage_hash "$deps" "$@")
+
+    local up_to_date=1 recorded=""
+    [ -f "$(stamp "$name")" ] && read -r recorded _ < "$(stamp "$name")"
+    if [ "${FORCE:-0}" = 1 ] || [ "$recorded" != "$hash" ]; then
+        up_to_date=0
+    fi
+    for out in $outputs; do
+        [ -e "$out" ] || up_to_date=0
+        # e.g. datasets/Climate left empty by a rerun of clean.sh
+        if [ -d "$out" ] && [ -z "$(ls -A "$out")" ]; then
+            up_to_date=0
+        fi
+    done
+
+    if [ "$up_to_date" = 1 ]; then
+        echo "[$name] up to date, skipping"
+        return 0
+    fi
+
+    echo "[$name] running"
+    local start=$SECONDS start_unix
+    start_unix=$(date +%s.%N)
+    # Not a subshell: errexit is ignored in every subshell of an if, && or
+    # || condition, and run_stage itself may be called in one
+    local status=0
+    bash -e -c "$(declare -f)"$'\n''"$@"' "stage-$name" "$@" || status=$?
+    if [ "$status" = 0 ]; then
+        echo "$hash $(date +%s.%N)" > "$(stamp "$name")"
+        echo "[$name] done in $((SECONDS - start)) s"
+        stage_report "$name" "$start_unix"
+    else
+        rm -f "$(stamp "$name")"
+        echo "[$name] failed with status $status" >&2
+        return $status
+    fi
+}
@@ -0,0 +1,53 @@
+#!/bin/bash
+# Combines the stage reports of a run (reports/*.json, written by the tools
+# through include/instrument.h and by bash/stage.sh) into one JSON array,
+# reports/timeline.json, and prints them as a table in start order:
+#
+#   ./bash/timeline.sh [REPORT_DIR]
+#
+# Times are wall seconds, start relative to the earliest report.
+set -e
+
+dir="${1:-${MNXB_REPORT_DIR:-reports}}"
+out="$dir/timeline.json"
+shopt -s nullglob
+reports=()
+for f in "$dir"/*.json; do
+    [ "$f" = "$out" ] || reports+=("$f")
+done
+if [ ${#reports[@]} = 0 ]; then
+    echo "No reports in $dir"
+    exit 0
+fi
+
+# The array of every report, in start order
+field() {
+    sed -n "s/^  \"$1\": \"\{0,1\}\([^\",]*\)\"\{0,1\},\{0,1\}$/\1/p" "$2"
+}
+sorted=$(for f in "${reports[@]}"; do
+    printf '%s %s\n' "$(field start_unix "$f")" "$f"
+done | sort -n | cut -d' ' -f2-)
+
+{
+    echo "["
+    first=1
+    while read -r f; do
+        [ "$first" = 1 ] || echo ","
+        first=0
+        sed 's/^/  /' "$f"
+    done <<< "$sorted"
+    echo "]"
+} > "$out"
+
+t0=$(field start_unix "$(head -n 1 <<< "$sorted")")
+printf '%-28s %9s %9s %12s %12s %10s\n' stage start_s wall_s rows MB peak_MB
+while read -r f; do
+    awk -v t0="$t0" -v stage="$(field stage "$f")" \
+        -v start="$(field start_unix "$f")" -v wall="$(field wall_s "$f")" \
+        -v rows="$(field rows "$f")" -v bytes="$(field bytes "$f")" \
+        -v rss="$(field peak_rss_bytes "$f")" 'BEGIN {
+        printf "%-28s %9.2f %9.2f %12d %12.1f %10.1f\n", stage, start - t0,
+               wall, rows, bytes / 1e6, rss / 1e6
+    }'
+done <<< "$sorted"
+echo "Timeline written to $out"
@@ -0,0 +1,70 @@
+#ifndef B_DAYS_H
+#define B_DAYS_H
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "filter.h"
+#include "station_cache.h"
+
+// Per-day averages of the rows that pass the filter, in one pass. The
+// accumulators only exist for selected dates, keyed (month, day, year) so
+// they come out grouped by date and sorted by year.
+class BirthdayAverages {
+ private:
+  const Filter& filter;
+  std::map<std::tuple<int, int, int>, std::pair<double, int>> data;
+
+  void accumulate(int year, int month, int day, double temp) {
+    auto& acc = data[std::make_tuple(month, day, year)];
+    acc.first += temp;
+    acc.second++;
+    ++kept;
+  }
+
+ public:
+  long rows = 0, kept = 0;
+
+  explicit BirthdayAverages(const Filter& f) : filter{f} {}
+
+  // Row at a time, for text input
+  void add(int year, int month, int day, int hour, double temp) {
+    ++rows;
+    if (filter.matches(year, month, day, hour))
+      accumulate(year, month, day, temp);
+  }
+
+  // A whole station at once: the filter runs over the columns in batches
+  // and only the selected rows are touched afterwards
+  void add(const StationView& v) {
+    std::vector<std::uint32_t> selection;
+    filter.select(v, selection);
+    rows += v.rows;
+    for (std::uint32_t i : selection)
+      accumulate(v.year[i], v.month[i], v.day[i], v.temperature[i]);
+  }
+
+  // Calls fn(year, month, day, average) for every date and year, grouped by
+  // date and sorted by year
+  template <typename Fn>
+  void forEachAverage(Fn&& fn) const {
+    for (const auto& [key, val] : data) {
+      auto [month, day, year] = key;
+      fn(year, month, day, val.first / val.second);
+    }
+  }
+
+  std::size_t write(const char* outputFile) const {
+    std::ofstream out(outputFile);
+    forEachAverage([&](int year, int month, int day, double average) {
+      out << year << ";" << month << ";" << day << ";" << average << "\n";
+    });
+    return data.size();
+  }
+};
+
+#endif /* B_DAYS_H */
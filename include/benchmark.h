@@ -0,0 +1,154 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A small microbenchmark harness for src/benchmark.cxx. A case is a function
+// that processes `rows` rows of a fixed input; it is run once to warm up
+// (page faults, caches, lazily built tables) and then timed `repetitions`
+// times. Per row times are reported as the median, the minimum and the
+// relative standard deviation over the repetitions, and throughput as rows
+// per second at the median, so a noisy machine shows up as a large spread
+// instead of a wrong number.
+//
+// BenchmarkSuite suite(repetitions, "", "");
+// suite.run("solar/dayOfYear", rows, [&] {
+//   for (...) sum += dayOfYear(y[i], m[i], d[i]);
+//   doNotOptimize(sum);
+// });
+// suite.writeCsv("bench.csv");  // later: --baseline bench.csv
+//
+// With a baseline (a CSV written by an earlier run) every case also prints
+// its speedup over the baseline's median.
+
+// Keeps the compiler from dropping a computation whose result is unused
+template <typename T>
+inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchmarkResult {
+  std::string name;
+  std::size_t rows = 0;
+  int repetitions = 0;
+  double median_ns = 0, min_ns = 0, mean_ns = 0, stddev_ns = 0;  // per row
+
+  double rowsPerSecond() const { return median_ns > 0 ? 1e9 / median_ns : 0; }
+};
+
+template <typename Fn>
+BenchmarkResult measure(std::string name, std::size_t rows, int repetitions,
+                        Fn&& fn) {
+  using Clock = std::chrono::steady_clock;
+  BenchmarkResult r;
+  r.name = std::move(name);
+  r.rows = std::max<std::size_t>(rows, 1);
+  r.repetitions = std::max(repetitions, 1);
+
+  fn();
+  std::vector<double> ns(r.repetitions);
+  for (double& t : ns) {
+    const auto start = Clock::now();
+    fn();
+    t = std::chrono::duration<double, std::nano>(Clock::now() - start)
+            .count() /
+        r.rows;
+  }
+
+  std::sort(ns.begin(), ns.end());
+  const std::size_t n = ns.size();
+  r.median_ns = n % 2 ? ns[n / 2] : 0.5 * (ns[n / 2 - 1] + ns[n / 2]);
+  r.min_ns = ns.front();
+  for (double t : ns) r.mean_ns += t / n;
+  if (n > 1) {
+    double var = 0;
+    for (double t : ns) var += (t - r.mean_ns) * (t - r.mean_ns);
+    r.stddev_ns = std::sqrt(var / (n - 1));
+  }
+  return r;
+}
+
+class BenchmarkSuite {
+ private:
+  int m_repetitions;
+  std::string m_filter;                     // substring of the case names
+  std::map<std::string, double> m_baseline;  // name -> median ns/row
+  std::vector<BenchmarkResult> m_results;
+
+  void print(const BenchmarkResult& r) const {
+    std::printf("%-34s %10zu %10.2f %10.2f %7.1f%% %12.3g", r.name.c_str(),
+                r.rows, r.median_ns, r.min_ns,
+                r.median_ns > 0 ? 100 * r.stddev_ns / r.median_ns : 0.0,
+                r.rowsPerSecond());
+    auto it = m_baseline.find(r.name);
+    if (it != m_baseline.end() && r.median_ns > 0)
+      std::printf(" %8.2fx", it->second / r.median_ns);
+    std::printf("\n");
+    std::fflush(stdout);
+  }
+
+ public:
+  BenchmarkSuite(int repetitions, std::string filter,
+                 const std::string& baseline_csv)
+      : m_repetitions{repetitions}, m_filter{std::move(filter)} {
+    if (!baseline_csv.empty()) readBaseline(baseline_csv);
+  }
+
+  // Reads the name and median of every case of an earlier writeCsv()
+  bool readBaseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open()) return false;
+    std::string line;
+    std::getline(in, line);  // header
+    while (std::getline(in, line)) {
+      std::istringstream fields(line);
+      std::string name, rows, reps, median;
+      if (std::getline(fields, name, ';') && std::getline(fields, rows, ';') &&
+          std::getline(fields, reps, ';') && std::getline(fields, median, ';'))
+        m_baseline[name] = std::stod(median);
+    }
+    return true;
+  }
+
+  void printHeader() const {
+    std::printf("%-34s %10s %10s %10s %8s %12s%s\n", "case", "rows",
+                "median", "min", "stddev", "rows/s",
+                m_baseline.empty() ? "" : "  vs base");
+    std::printf("%-34s %10s %10s %10s %8s %12s\n", "", "", "ns/row",
+                "ns/row", "", "");
+  }
+
+  // Runs `fn` as case `name` unless the filter excludes it
+  template <typename Fn>
+  void run(const std::string& name, std::size_t rows, Fn&& fn) {
+    if (!m_filter.empty() && name.find(m_filter) == std::string::npos) return;
+    m_results.push_back(measure(name, rows, m_repetitions, fn));
+    print(m_results.back());
+  }
+
+  const std::vector<BenchmarkResult>& results() const { return m_results; }
+
+  bool writeCsv(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out.is_open()) return false;
+    out << "case;rows;repetitions;median_ns;min_ns;mean_ns;stddev_ns;"
+           "rows_per_s\n";
+    for (const BenchmarkResult& r : m_results)
+      out << r.name << ";" << r.rows << ";" << r.repetitions << ";"
+          << r.median_ns << ";" << r.min_ns << ";" << r.mean_ns << ";"
+          << r.stddev_ns << ";" << r.rowsPerSecond() << "\n";
+    return true;
+  }
+};
+
+#endif /* BENCHMARK_H */
@@ -1 +1,71 @@
-#pragma once
\ No newline at end of file
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+// Streaming period summaries of climate.cxx: the rows of a station, in time
+// order, are folded into one max/min/mean line per year, month or day.
+
+// Running max/min/mean of one period
+struct Accumulator {
+  double max = -std::numeric_limits<double>::infinity();
+  double min = std::numeric_limits<double>::infinity();
+  double sum = 0;
+  long count = 0;
+
+  void add(double t) {
+    max = std::max(max, t);
+    min = std::min(min, t);
+    sum += t;
+    ++count;
+  }
+};
+
+// Writes one line per period, where a period is the first `depth` fields of
+// (year, month, day). The line for a period is written as soon as a row of
+// the next period arrives.
+class PeriodSummary {
+ private:
+  std::ofstream m_out;
+  int m_depth;
+  int m_key[3] = {0, 0, 0};
+  bool m_active = false;
+  Accumulator m_acc;
+  long m_periods = 0;
+
+  void flush() {
+    for (int i = 0; i < m_depth; ++i) m_out << m_key[i] << "; ";
+    m_out << m_acc.max << "; " << m_acc.min << "; "
+          << m_acc.sum / m_acc.count << "\n";
+    ++m_periods;
+  }
+
+ public:
+  PeriodSummary(const std::filesystem::path& file, int depth)
+      : m_out{file}, m_depth{depth} {}
+
+  bool is_open() const { return m_out.is_open(); }
+  long periods() const { return m_periods; }
+
+  void add(int year, int month, int day, double t) {
+    const int key[3] = {year, month, day};
+    if (m_active && !std::equal(key, key + m_depth, m_key)) {
+      flush();
+      m_active = false;
+    }
+    if (!m_active) {
+      std::copy(key, key + 3, m_key);
+      m_acc = Accumulator{};
+      m_active = true;
+    }
+    m_acc.add(t);
+  }
+
+  void finish() {
+    if (m_active) flush();
+    m_active = false;
+    m_out.close();
+  }
+};
@@ -0,0 +1,91 @@
+#ifndef CSV_TO_ROOT_H
+#define CSV_TO_ROOT_H
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parse_utils.h"
+
+// Row parsing of csv_to_root.cxx, without ROOT.
+
+// The two CSV formats we convert: the cleaned hourly station files
+// (year;month;day;hour;temperature;latitude;longitude) and the yearly
+// summaries written by climate/sweden_average (year;max;min;mean)
+enum class Layout { Unknown, Hourly, Yearly };
+
+// One parsed CSV row, covering both the full and the minimal format
+struct Row {
+  Layout layout = Layout::Unknown;
+  int year = 0, month = 0, day = 0, hour = 0;
+  double temperature = 0, latitude = 0, longitude = 0;
+  double max_temp = 0, min_temp = 0, mean_temp = 0;
+};
+
+// Tokenizing of the line by line reader: one std::stringstream and token
+// vector per row, numbers by std::stoi/std::stod. Returns false for lines
+// without 7 or 4 columns and for fields without a number.
+inline bool tokenizeRow(const std::string& line, Row& r) {
+  std::stringstream ss(line);
+  std::string token;
+  std::vector<std::string> tokens;
+
+  // Split line into tokens
+  while (std::getline(ss, token, ';')) {
+    tokens.push_back(token);
+  }
+
+  try {
+    if (tokens.size() == 7) {
+      // Full CSV
+      r.layout = Layout::Hourly;
+      r.year = std::stoi(tokens[0]);
+      r.month = std::stoi(tokens[1]);
+      r.day = std::stoi(tokens[2]);
+      r.hour = std::stoi(tokens[3]);
+      r.temperature = std::stod(tokens[4]);
+      r.latitude = std::stod(tokens[5]);
+      r.longitude = std::stod(tokens[6]);
+      return true;
+    }
+    if (tokens.size() == 4) {
+      // Minimal CSV
+      r.layout = Layout::Yearly;
+      r.year = std::stoi(tokens[0]);
+      r.max_temp = std::stod(tokens[1]);
+      r.min_temp = std::stod(tokens[2]);
+      r.mean_temp = std::stod(tokens[3]);
+      return true;
+    }
+  } catch (const std::logic_error&) {
+    // std::invalid_argument or std::out_of_range of stoi/stod
+  }
+  return false;
+}
+
+// Allocation-free version of tokenizeRow(), used by the --mmap reader.
+// Returns false for lines that do not have 7 or 4 numeric columns.
+inline bool parseRow(std::string_view line, Row& r) {
+  std::string_view f[7];
+  int n = splitFields(line, ';', f, 7);
+
+  if (n == 7) {
+    // Full CSV
+    r.layout = Layout::Hourly;
+    return parseInt(f[0], r.year) && parseInt(f[1], r.month) &&
+           parseInt(f[2], r.day) && parseInt(f[3], r.hour) &&
+           parseDouble(f[4], r.temperature) && parseDouble(f[5], r.latitude) &&
+           parseDouble(f[6], r.longitude);
+  }
+  if (n == 4) {
+    // Minimal CSV
+    r.layout = Layout::Yearly;
+    return parseInt(f[0], r.year) && parseDouble(f[1], r.max_temp) &&
+           parseDouble(f[2], r.min_temp) && parseDouble(f[3], r.mean_temp);
+  }
+  return false;
+}
+
+#endif /* CSV_TO_ROOT_H */
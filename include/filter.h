@@ -0,0 +1,113 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "station_cache.h"
+
+// Row filters for station data, written as a small expression instead of an
+// awk one-liner or a hand-written loop. An expression is a list of clauses
+// separated by spaces; a row has to pass every clause. Within a clause the
+// comma separated values are alternatives and A-B is an inclusive range:
+//
+//   hour=11-15                   UTC hours
+//   date=11-06,04-12,03-11       month-day pairs (MM-DD)
+//   year=1850-1900,1990-2024     years
+//   month=6-8 day=1-7            months, days of the month
+//   station=Lund,Uppsala         station (city) names
+//   quality=G,Y                  SMHI quality codes
+//   temp=25..  temp=-5..5        temperatures (deg C), LO..HI, inclusive,
+//                                either end may be left out
+//
+// e.g. "year=1990-2024 month=6-8 station=Lund" for summers since 1990 in
+// Lund. compile() turns the expression into lookup tables; select() then
+// evaluates it over column arrays in batches and produces a selection vector
+// of the matching row indices. Blocks whose zone map (see station_cache.h)
+// shows that no row can pass are skipped without reading their rows.
+//
+// Filter summer;
+// std::string error;
+// if (!summer.compile("month=6-8 quality=G", error)) { ... }
+// std::vector<std::uint32_t> rows;
+// summer.select(cache.view(), rows);
+class Filter {
+ private:
+  std::string m_expr;
+
+  // One byte per possible value, 1 if the value passes. Tables of clauses
+  // that are not in the expression are all ones.
+  std::uint8_t m_hour[256];
+  std::uint8_t m_month[256];
+  std::uint8_t m_day[256];
+  std::uint8_t m_date[16 * 32];  // month * 32 + day
+  std::uint8_t m_quality[256];
+  std::vector<std::pair<int, int>> m_years;  // empty means any year
+  std::vector<std::string> m_stations;       // empty means any station
+  bool m_has_date = false;
+  bool m_has_temperature = false;
+  float m_temperature_lo = 0, m_temperature_hi = 0;
+
+  bool parseClause(std::string_view clause, std::string& error);
+
+ public:
+  // An empty filter, every row passes
+  Filter();
+
+  // Replaces this filter by the compiled `expr`. On a syntax error returns
+  // false, leaves a message in `error` and the filter unchanged.
+  bool compile(const std::string& expr, std::string& error);
+
+  // The expression this filter was compiled from
+  const std::string& expression() const { return m_expr; }
+
+  // Whether rows of this station can pass at all
+  bool matchesStation(std::string_view name) const;
+
+  // Scalar test of one row, for row-at-a-time readers of text files. The
+  // temp clause is tested separately by temperaturePasses().
+  bool matches(int year, int month, int day, int hour,
+               char quality = 'G') const {
+    auto u = [](int v) { return static_cast<unsigned>(v) & 0xffu; };
+    return yearPasses(year) && m_hour[u(hour)] && m_month[u(month)] &&
+           m_day[u(day)] && m_quality[static_cast<unsigned char>(quality)] &&
+           (!m_has_date ||
+            (month >= 0 && month <= 12 && day >= 0 && day <= 31 &&
+             m_date[month * 32 + day]));
+  }
+
+  bool yearPasses(int year) const {
+    if (m_years.empty()) return true;
+    for (const auto& [lo, hi] : m_years)
+      if (year >= lo && year <= hi) return true;
+    return false;
+  }
+
+  bool temperaturePasses(double t) const {
+    return !m_has_temperature ||
+           (t >= m_temperature_lo && t <= m_temperature_hi);
+  }
+
+  // False if no row of the block described by `zone` can pass
+  bool mayMatch(const ZoneMap& zone) const;
+
+  // The number of zone map blocks of `v` that select() reads
+  std::size_t candidateBlocks(const StationView& v) const;
+
+  // Appends the indices of the rows in [begin, end) of `v` that pass to
+  // `selection`. The station clause is not checked here, see
+  // matchesStation(). Returns the number of rows appended.
+  std::size_t select(const StationView& v, std::size_t begin, std::size_t end,
+                     std::vector<std::uint32_t>& selection) const;
+
+  std::size_t select(const StationView& v,
+                     std::vector<std::uint32_t>& selection) const {
+    return select(v, 0, v.rows, selection);
+  }
+};
+
+#endif /* FILTER_H */
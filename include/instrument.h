@@ -0,0 +1,159 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+// Where a stage spends its time. Each tool keeps one StageReport, times its
+// phases (parse, aggregate, write, ...) with ScopedPhase, counts the rows
+// and bytes it handled, and at the end writes reports/<stage>.json with the
+// wall times, the counters and the peak resident memory of the process.
+// bash/timeline.sh combines the reports of a run into one timeline.
+//
+// StageReport report("climate");
+// {
+//   ScopedPhase phase(report, "parse");
+//   ...
+//   phase.addRows(rows);
+// }
+// report.write();
+//
+// The report directory is $MNXB_REPORT_DIR, or reports/ if unset. Phases and
+// counters may be recorded from several threads.
+
+// Peak resident set size of this process so far, in bytes
+inline std::uint64_t peakRssBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;  // KiB on Linux
+}
+
+inline double unixSeconds() {
+  using namespace std::chrono;
+  return duration<double>(system_clock::now().time_since_epoch()).count();
+}
+
+class StageReport {
+ public:
+  struct Phase {
+    std::string name;
+    double start_s;  // since the stage started
+    double wall_s;
+    std::uint64_t rows, bytes;
+  };
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  std::string m_stage;
+  double m_start_unix;
+  Clock::time_point m_start;
+  std::atomic<std::uint64_t> m_rows{0}, m_bytes{0};
+  std::mutex m_mutex;
+  std::vector<Phase> m_phases;
+
+  static std::string escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+      if (c == '"' || c == '\\') out += '\\';
+      if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out;
+  }
+
+ public:
+  explicit StageReport(std::string stage)
+      : m_stage{std::move(stage)},
+        m_start_unix{unixSeconds()},
+        m_start{Clock::now()} {}
+
+  const std::string& stage() const { return m_stage; }
+  double elapsed() const {
+    return std::chrono::duration<double>(Clock::now() - m_start).count();
+  }
+
+  // Totals of the whole stage
+  void addRows(std::uint64_t n) { m_rows += n; }
+  void addBytes(std::uint64_t n) { m_bytes += n; }
+
+  void addPhase(Phase phase) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_phases.push_back(std::move(phase));
+  }
+
+  // Writes <dir>/<stage>.json, returns false if it cannot
+  bool write() {
+    const char* env = std::getenv("MNXB_REPORT_DIR");
+    const std::filesystem::path dir = env && *env ? env : "reports";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    std::ofstream out(dir / (m_stage + ".json"));
+    if (!out.is_open()) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out.precision(6);
+    out << std::fixed << "{\n"
+        << "  \"stage\": \"" << escape(m_stage) << "\",\n"
+        << "  \"start_unix\": " << m_start_unix << ",\n"
+        << "  \"wall_s\": " << elapsed() << ",\n"
+        << "  \"rows\": " << m_rows.load() << ",\n"
+        << "  \"bytes\": " << m_bytes.load() << ",\n"
+        << "  \"peak_rss_bytes\": " << peakRssBytes() << ",\n"
+        << "  \"phases\": [";
+    for (std::size_t i = 0; i < m_phases.size(); ++i) {
+      const Phase& p = m_phases[i];
+      out << (i ? "," : "") << "\n    {\"name\": \"" << escape(p.name)
+          << "\", \"start_s\": " << p.start_s << ", \"wall_s\": " << p.wall_s
+          << ", \"rows\": " << p.rows << ", \"bytes\": " << p.bytes << "}";
+    }
+    out << (m_phases.empty() ? "" : "\n  ") << "]\n}\n";
+    return true;
+  }
+};
+
+// Times one phase of a stage from construction to destruction (or to
+// stop()). Rows and bytes added here count for the phase and the stage.
+class ScopedPhase {
+ private:
+  StageReport& m_report;
+  std::string m_name;
+  double m_start;
+  std::uint64_t m_rows = 0, m_bytes = 0;
+  bool m_running = true;
+
+ public:
+  ScopedPhase(StageReport& report, std::string name)
+      : m_report{report}, m_name{std::move(name)}, m_start{report.elapsed()} {}
+  ScopedPhase(const ScopedPhase&) = delete;
+  ScopedPhase& operator=(const ScopedPhase&) = delete;
+  ~ScopedPhase() { stop(); }
+
+  void addRows(std::uint64_t n) {
+    m_rows += n;
+    m_report.addRows(n);
+  }
+  void addBytes(std::uint64_t n) {
+    m_bytes += n;
+    m_report.addBytes(n);
+  }
+
+  void stop() {
+    if (!m_running) return;
+    m_running = false;
+    m_report.addPhase(
+        {m_name, m_start, m_report.elapsed() - m_start, m_rows, m_bytes});
+  }
+};
+
+#endif /* INSTRUMENT_H */
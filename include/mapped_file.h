@@ -0,0 +1,87 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Read-only memory mapping of a whole file. The pages are shared with the
+// kernel page cache, so reading a file through data()/view() does not copy
+// it into our own buffers. The mapping is released in the destructor.
+//
+// MappedFile file{"datasets/clean/Lund.csv"};
+// if (!file.is_open()) { ... }
+// std::string_view text = file.view();
+class MappedFile {
+ private:
+  const char* m_data = nullptr;
+  std::size_t m_size = 0;
+  bool m_open = false;
+
+  void release() {
+    if (m_data) munmap(const_cast<char*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+  }
+
+ public:
+  MappedFile() = default;
+
+  explicit MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      m_size = static_cast<std::size_t>(st.st_size);
+      if (m_size == 0) {
+        // mmap refuses empty ranges, an empty file is still a valid file
+        m_open = true;
+      } else {
+        void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+          m_data = static_cast<const char*>(p);
+          m_open = true;
+          // We parse front to back, let the kernel read ahead aggressively
+          madvise(p, m_size, MADV_SEQUENTIAL);
+        } else {
+          m_size = 0;
+        }
+      }
+    }
+    ::close(fd);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept
+      : m_data{std::exchange(other.m_data, nullptr)},
+        m_size{std::exchange(other.m_size, 0)},
+        m_open{std::exchange(other.m_open, false)} {}
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      release();
+      m_data = std::exchange(other.m_data, nullptr);
+      m_size = std::exchange(other.m_size, 0);
+      m_open = std::exchange(other.m_open, false);
+    }
+    return *this;
+  }
+
+  ~MappedFile() { release(); }
+
+  bool is_open() const { return m_open; }
+  const char* data() const { return m_data; }
+  std::size_t size() const { return m_size; }
+  std::string_view view() const { return {m_data, m_size}; }
+};
+
+#endif /* MAPPED_FILE_H */
@@ -0,0 +1,54 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the user did not ask for a specific
+// count. hardware_concurrency() may return 0 if it cannot tell.
+inline unsigned defaultThreads() {
+  unsigned n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+// Parses the value of a "-j N" option. Falls back to defaultThreads() for
+// anything that is not a positive number.
+inline unsigned parseThreads(const std::string& value) {
+  try {
+    int n = std::stoi(value);
+    if (n > 0) return static_cast<unsigned>(n);
+  } catch (...) {
+  }
+  return defaultThreads();
+}
+
+// Runs fn(i) for every i in [0, n) on at most `threads` worker threads.
+// Indices are handed out one at a time, so a few large station files do not
+// leave the other threads idle. fn must be safe to call concurrently for
+// different indices.
+template <typename Fn>
+void parallelFor(std::size_t n, unsigned threads, Fn&& fn) {
+  if (n == 0) return;
+  threads = std::max(1u, std::min<unsigned>(threads, n));
+  if (threads == 1) {
+    for (std::size_t i = 0; i < n; ++i) fn(i);
+    return;
+  }
+
+  std::atomic<std::size_t> next{0};
+  auto worker = [&]() {
+    for (std::size_t i = next++; i < n; i = next++) fn(i);
+  };
+
+  std::vector<std::thread> pool;
+  pool.reserve(threads - 1);
+  for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+  worker();
+  for (auto& th : pool) th.join();
+}
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,101 @@
+#ifndef PARSE_UTILS_H
+#define PARSE_UTILS_H
+
+#include <charconv>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Small allocation-free helpers for the ';'-separated text files that flow
+// through the pipeline. Everything works on std::string_view so a line can be
+// split and converted without building a std::stringstream or a
+// std::vector<std::string> per row.
+
+// Splits `line` on `sep` and stores up to `max_fields` views in `fields`.
+// Returns the number of fields in the line, which may be larger than
+// `max_fields`. Like std::getline, a trailing separator does not produce an
+// extra empty field, so "a;b;" has two fields.
+inline int splitFields(std::string_view line, char sep,
+                       std::string_view* fields, int max_fields) {
+  int count = 0;
+  std::size_t start = 0;
+  while (start < line.size()) {
+    std::size_t end = line.find(sep, start);
+    if (end == std::string_view::npos) end = line.size();
+    if (count < max_fields) fields[count] = line.substr(start, end - start);
+    ++count;
+    start = end + 1;
+  }
+  return count;
+}
+
+// Removes any of the characters in `chars` from both ends of `s`.
+inline std::string_view trim(std::string_view s,
+                             std::string_view chars = " \t\r") {
+  std::size_t b = s.find_first_not_of(chars);
+  if (b == std::string_view::npos) return {};
+  std::size_t e = s.find_last_not_of(chars);
+  return s.substr(b, e - b + 1);
+}
+
+// Drops leading blanks and a '+' sign, mirroring what std::stoi/std::stod
+// accept ("1900; 12.5" is written by climate.cxx).
+inline std::string_view numberPrefix(std::string_view s) {
+  std::size_t b = s.find_first_not_of(" \t");
+  if (b == std::string_view::npos) return {};
+  s.remove_prefix(b);
+  if (!s.empty() && s.front() == '+') s.remove_prefix(1);
+  return s;
+}
+
+// Converts the leading integer in `s`. Trailing characters (e.g. '\r') are
+// ignored, as with std::stoi. Returns false if there is no number at all.
+inline bool parseInt(std::string_view s, int& out) {
+  s = numberPrefix(s);
+  auto res = std::from_chars(s.data(), s.data() + s.size(), out);
+  return res.ec == std::errc();
+}
+
+// Converts the leading floating point number in `s`, see parseInt.
+inline bool parseDouble(std::string_view s, double& out) {
+  s = numberPrefix(s);
+  auto res = std::from_chars(s.data(), s.data() + s.size(), out);
+  return res.ec == std::errc();
+}
+
+// Calls fn(line) for every line in `text`, without the trailing newline.
+template <typename Fn>
+inline void forEachLine(std::string_view text, Fn&& fn) {
+  std::size_t start = 0;
+  while (start < text.size()) {
+    std::size_t end = text.find('\n', start);
+    if (end == std::string_view::npos) end = text.size();
+    fn(text.substr(start, end - start));
+    start = end + 1;
+  }
+}
+
+// Cuts `text` into at most `parts` pieces of roughly equal size. Every cut is
+// moved forward to just after a newline, so each piece holds whole lines and
+// can be parsed independently. Concatenating the pieces gives back `text`.
+inline std::vector<std::string_view> splitChunks(std::string_view text,
+                                                 std::size_t parts) {
+  std::vector<std::string_view> chunks;
+  if (parts == 0) parts = 1;
+  const std::size_t target = text.size() / parts + 1;
+  std::size_t start = 0;
+  while (start < text.size()) {
+    std::size_t end = start + target;
+    if (end >= text.size()) {
+      end = text.size();
+    } else {
+      end = text.find('\n', end);
+      end = (end == std::string_view::npos) ? text.size() : end + 1;
+    }
+    chunks.push_back(text.substr(start, end - start));
+    start = end;
+  }
+  return chunks;
+}
+
+#endif /* PARSE_UTILS_H */
@@ -0,0 +1,22 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// Entry points of the pipeline tools, for the driver in main.cxx. Compiled
+// with -DPIPELINE_DRIVER the tools leave out their main(), and the driver
+// calls these with the command line the tool would have been given.
+
+int cleanMain(int argc, char* argv[]);          // src/clean.cxx
+int climateMain(int argc, char* argv[]);        // src/climate.cxx
+int swedenAverageMain(int argc, char* argv[]);  // src/sweden_average.cxx
+int trendsMain(int argc, char* argv[]);         // src/trends.cxx
+int bdaysMain(int argc, char* argv[]);          // src/b-days.cxx
+int csvToRootMain(int argc, char* argv[]);      // src/csv_to_root.cxx
+int plotClimateMain(int argc, char* argv[]);    // src/plot_climate.cxx
+int serveMain(int argc, char* argv[]);          // src/serve.cxx
+int askMain(int argc, char* argv[]);            // src/serve.cxx
+
+// The ACLiC macros, which keep their own entry points
+int adjustTemps(unsigned threads);  // src/solar.cxx
+int plot_solar(unsigned threads);   // src/plot_solar.cxx
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,194 @@
+#ifndef ROLLING_H
+#define ROLLING_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Rolling-window statistics over evenly spaced series, a value per year or
+// per month (step (year - first_year) * 12 + month - 1, see monthStep()).
+// Every step costs O(1) amortized: the mean and the variance come from
+// running sums that values enter and leave, the minimum and the maximum
+// from monotonic queues. A NaN is a gap: it keeps its place in the window
+// but is not counted, and a window with fewer than min_count values gives
+// NaN instead of a value from a handful of years.
+//
+// RollingOptions opt;
+// opt.window = 10;                 // decadal running mean
+// std::vector<RollingStats> smooth = rolling(yearly_means, opt);
+// smooth[i].mean                   // mean of the window around step i
+//
+// Monthly series keep their seasonal cycle unless the window is a whole
+// number of years.
+
+enum class Alignment {
+  Trailing,  // the window ends at its step
+  Centred,   // the window is centred on its step; an even window reaches
+             // one step further back than forward
+};
+
+struct RollingOptions {
+  std::size_t window = 10;
+  Alignment align = Alignment::Centred;
+  std::size_t min_count = 0;  // 0: half the window, rounded up
+
+  std::size_t minCount() const {
+    return min_count > 0 ? min_count : (window + 1) / 2;
+  }
+};
+
+struct RollingStats {
+  double mean = std::numeric_limits<double>::quiet_NaN();
+  double variance = std::numeric_limits<double>::quiet_NaN();  // sample
+  double min = std::numeric_limits<double>::quiet_NaN();
+  double max = std::numeric_limits<double>::quiet_NaN();
+  std::size_t count = 0;  // values in the window, gaps not counted
+
+  bool valid() const { return !std::isnan(mean); }
+  double sd() const { return std::sqrt(variance); }
+};
+
+// The last `window` values of a series pushed one step at a time
+class RollingWindow {
+ private:
+  std::size_t m_window;
+  std::vector<double> m_ring;  // value of step s at s % window
+  long m_step = 0;             // steps pushed so far
+  // Sums of (x - shift), the shift being the first value of the current
+  // run, so that the variance does not cancel away
+  double m_shift = 0, m_sum = 0, m_sum2 = 0;
+  std::size_t m_count = 0;
+  // (step, value), increasing values in m_min, decreasing in m_max
+  std::deque<std::pair<long, double>> m_min, m_max;
+
+ public:
+  explicit RollingWindow(std::size_t window)
+      : m_window(window > 0 ? window : 1),
+        m_ring(m_window, std::numeric_limits<double>::quiet_NaN()) {}
+
+  // Appends the next step; NaN for a gap
+  void push(double value) {
+    double& slot = m_ring[m_step % m_window];
+    if (!std::isnan(slot)) {
+      const double d = slot - m_shift;
+      m_sum -= d;
+      m_sum2 -= d * d;
+      --m_count;
+    }
+    slot = value;
+    if (!std::isnan(value)) {
+      if (m_count == 0) {
+        m_shift = value;
+        m_sum = m_sum2 = 0;
+      }
+      const double d = value - m_shift;
+      m_sum += d;
+      m_sum2 += d * d;
+      ++m_count;
+      while (!m_min.empty() && m_min.back().second >= value) m_min.pop_back();
+      while (!m_max.empty() && m_max.back().second <= value) m_max.pop_back();
+      m_min.emplace_back(m_step, value);
+      m_max.emplace_back(m_step, value);
+    }
+    ++m_step;
+    const long first = m_step - static_cast<long>(m_window);
+    while (!m_min.empty() && m_min.front().first < first) m_min.pop_front();
+    while (!m_max.empty() && m_max.front().first < first) m_max.pop_front();
+  }
+
+  std::size_t count() const { return m_count; }
+
+  // Statistics of the window; NaN with fewer than min_count values
+  RollingStats stats(std::size_t min_count = 1) const {
+    RollingStats r;
+    r.count = m_count;
+    if (m_count == 0 || m_count < min_count) return r;
+    const double n = static_cast<double>(m_count);
+    const double mean = m_sum / n;
+    r.mean = m_shift + mean;
+    if (m_count > 1)
+      r.variance = std::max(0.0, (m_sum2 - n * mean * mean) / (n - 1));
+    r.min = m_min.front().second;
+    r.max = m_max.front().second;
+    return r;
+  }
+};
+
+// Rolling statistics of every step of `series` in one pass. A centred
+// window is read (window - 1) / 2 steps behind the input, the steps past
+// the end counting as gaps.
+inline std::vector<RollingStats> rolling(const std::vector<double>& series,
+                                         const RollingOptions& options) {
+  RollingWindow window(options.window);
+  const std::size_t lead =
+      options.align == Alignment::Centred ? (options.window - 1) / 2 : 0;
+  const std::size_t min_count = options.minCount();
+  std::vector<RollingStats> out(series.size());
+  for (std::size_t step = 0; step < series.size() + lead; ++step) {
+    window.push(step < series.size()
+                    ? series[step]
+                    : std::numeric_limits<double>::quiet_NaN());
+    if (step >= lead) out[step - lead] = window.stats(min_count);
+  }
+  return out;
+}
+
+// The step of a month in a monthly series starting in January of
+// first_year, e.g. the monthly means of plot_solar.cxx
+inline std::size_t monthStep(int year, int month, int first_year) {
+  return static_cast<std::size_t>(year - first_year) * 12 + (month - 1);
+}
+
+// A series given as (year, value) pairs in any order, e.g. the rows of a
+// yearly tree, laid out one step per year from the first year to the last.
+// Several values of a year are averaged, years without one are gaps.
+struct YearSeries {
+  int first_year = 0;
+  std::vector<double> values;
+
+  YearSeries(const double* years, const double* values_in, std::size_t n) {
+    if (n == 0) return;
+    double lo = years[0], hi = years[0];
+    for (std::size_t i = 1; i < n; ++i) {
+      lo = std::min(lo, years[i]);
+      hi = std::max(hi, years[i]);
+    }
+    first_year = static_cast<int>(std::lround(lo));
+    const std::size_t steps = std::lround(hi) - first_year + 1;
+    std::vector<double> sums(steps, 0);
+    std::vector<int> counts(steps, 0);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (std::isnan(values_in[i])) continue;
+      const std::size_t step = std::lround(years[i]) - first_year;
+      sums[step] += values_in[i];
+      ++counts[step];
+    }
+    values.assign(steps, std::numeric_limits<double>::quiet_NaN());
+    for (std::size_t s = 0; s < steps; ++s)
+      if (counts[s] > 0) values[s] = sums[s] / counts[s];
+  }
+
+  int year(std::size_t step) const {
+    return first_year + static_cast<int>(step);
+  }
+
+  // The years whose window has enough data and their running means, e.g.
+  // the points of a TGraph
+  void runningMean(const RollingOptions& options, std::vector<double>& x,
+                   std::vector<double>& y) const {
+    x.clear();
+    y.clear();
+    const std::vector<RollingStats> smooth = rolling(values, options);
+    for (std::size_t s = 0; s < smooth.size(); ++s) {
+      if (!smooth[s].valid()) continue;
+      x.push_back(year(s));
+      y.push_back(smooth[s].mean);
+    }
+  }
+};
+
+#endif /* ROLLING_H */
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Top-of-atmosphere solar geometry used by the solar adjustment (solar.cxx)
+// and its plots. Times are UTC, on the hour; longitudes east and latitudes
+// north are positive.
+
+// ------------------ Solar math ------------------
+constexpr double PI = 3.14159265358979323846;
+constexpr double DEG2RAD = PI / 180.0;
+constexpr double I_sc = 1367.0;  // W/m^2 (solar constant)
+
+// Beta (°C per W/m^2) of the adjustment T_adj = T - beta * (G0h - G0h_mean).
+// Adjust if you’ve fitted a slope.
+constexpr double kSolarBeta = 0.003;
+
+// The rows the solar adjustment uses, as a filter expression (filter.h):
+// quality G between 11 and 15 UTC, the hours of the Solar/ subset
+constexpr const char* kSolarRowFilter = "hour=11-15 quality=G";
+
+inline bool isLeap(int year) {
+  return (year % 400 == 0) || (year % 4 == 0 && year % 100 != 0);
+}
+
+// 1..365 (366 in leap years), -1 for an invalid date
+inline int dayOfYear(int y, int m, int d) {
+  static const int cum[12] = {0,   31,  59,  90,  120, 151,
+                              181, 212, 243, 273, 304, 334};
+  int maxd = (m == 2 ? (isLeap(y) ? 29 : 28)
+                     : (m == 4 || m == 6 || m == 9 || m == 11 ? 30 : 31));
+  if (m < 1 || m > 12 || d < 1 || d > maxd) return -1;
+  int J = cum[m - 1] + d;
+  if (m > 2 && isLeap(y)) ++J;
+  return J;
+}
+
+inline double equationOfTime_min(int J) {
+  double B = 2.0 * PI * (J - 81) / 364.0;
+  return 9.87 * std::sin(2.0 * B) - 7.53 * std::cos(B) - 1.5 * std::sin(B);
+}
+inline double solarDeclination_rad(int J) {
+  return 23.45 * DEG2RAD * std::sin(2.0 * PI * (284.0 + J) / 365.0);
+}
+inline double eccentricityCorr(int J) {
+  return 1.0 + 0.033 * std::cos(2.0 * PI * J / 365.0);
+}
+inline double cosZenith(double lat_rad, double decl_rad,
+                        double hour_angle_rad) {
+  return std::sin(lat_rad) * std::sin(decl_rad) +
+         std::cos(lat_rad) * std::cos(decl_rad) * std::cos(hour_angle_rad);
+}
+
+// TOA horizontal irradiance [W/m^2] on day of year J (1..366)
+inline double toaIrradianceOnDay_Wm2(int J, int hourUTC, double lon_deg,
+                                     double lat_deg) {
+  const double EoT = equationOfTime_min(J);
+  const double lst =
+      hourUTC + (lon_deg * 4.0 + EoT) / 60.0;        // local solar time [h]
+  const double H = (15.0 * (lst - 12.0)) * DEG2RAD;  // hour angle [rad]
+
+  const double delta = solarDeclination_rad(J);
+  const double lat = lat_deg * DEG2RAD;
+  const double mu0 = cosZenith(lat, delta, H);
+  if (mu0 <= 0.0) return 0.0;
+
+  const double E0 = eccentricityCorr(J);
+  return I_sc * E0 * mu0;
+}
+
+// Instantaneous TOA horizontal irradiance [W/m^2]
+// Inputs: UTC hour (integer hour), lon/lat in degrees (east+/north+)
+inline double toaHorizontalIrradiance_Wm2(int year, int month, int day,
+                                          int hourUTC, double lon_deg,
+                                          double lat_deg) {
+  int J = dayOfYear(year, month, day);
+  if (J < 1) return 0.0;
+  return toaIrradianceOnDay_Wm2(J, hourUTC, lon_deg, lat_deg);
+}
+
+// Mean TOA horizontal irradiance at same UTC hour across the year [W/m^2]
+inline double meanToaIrradiance_Wm2_sameHour(int year, int hourUTC,
+                                             double lon_deg, double lat_deg) {
+  const int days = isLeap(year) ? 366 : 365;
+  double sum = 0.0;
+  for (int J = 1; J <= days; ++J)
+    sum += toaIrradianceOnDay_Wm2(J, hourUTC, lon_deg, lat_deg);
+  return sum / days;
+}
+
+// ------------------ Batch kernel ------------------
+
+// sin and cos without library calls, so that loops over arrays of angles
+// vectorize. The argument is reduced to [-pi/2, pi/2] and a degree 15
+// Taylor polynomial is evaluated there. Absolute error below 1e-9 for
+// |x| < 1e4, which is far more than the solar geometry needs.
+inline double polySin(double x) {
+  // x = n * pi + r with n the nearest integer to x / pi, so sin(x) is
+  // sin(r) with the sign of (-1)^n. Adding and subtracting 1.5 * 2^52
+  // rounds to an integer in plain double arithmetic and the sign is
+  // arithmetic as well: no selects, which GCC would keep as branches.
+  constexpr double kRound = 6755399441055744.0;
+  const double n = (x * (1.0 / PI) + kRound) - kRound;
+  const double half = (0.5 * n + kRound) - kRound;  // n / 2 rounded
+  const double sign = 1.0 - 2.0 * std::fabs(n - 2.0 * half);
+  const double r = sign * (x - n * PI);  // [-pi/2, pi/2]
+  const double r2 = r * r;
+  // Horner form of r - r^3/3! + r^5/5! - ... - r^15/15!
+  double p = -1.0 / 1307674368000.0;
+  p = p * r2 + 1.0 / 6227020800.0;
+  p = p * r2 - 1.0 / 39916800.0;
+  p = p * r2 + 1.0 / 362880.0;
+  p = p * r2 - 1.0 / 5040.0;
+  p = p * r2 + 1.0 / 120.0;
+  p = p * r2 - 1.0 / 6.0;
+  p = p * r2 + 1.0;
+  return r * p;
+}
+inline double polyCos(double x) { return polySin(x + 0.5 * PI); }
+
+// Fills g0h[i] with the TOA horizontal irradiance [W/m^2] for day of year
+// doy[i] (1..366, anything below 1 gives 0), UTC hour hour[i] and position
+// lon_deg[i]/lat_deg[i], for i < n. Branch free, so the loop vectorizes;
+// GCC only does that at -O3 while the tools are built at -O2, so the kernel
+// asks for -O3 itself, plus an AVX2 clone picked at run time. Agrees with
+// toaIrradianceOnDay_Wm2 within kBatchIrradianceTolerance_Wm2.
+constexpr double kBatchIrradianceTolerance_Wm2 = 1e-6;
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define SOLAR_BATCH_O3 \
+  __attribute__((optimize("O3"), target_clones("avx2", "default")))
+#else
+#define SOLAR_BATCH_O3
+#endif
+
+SOLAR_BATCH_O3 inline void toaHorizontalIrradianceBatch(
+    const int* doy, const int* hour, const double* lon_deg,
+    const double* lat_deg, double* g0h, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) {
+    const double J = doy[i];
+    const double B = 2.0 * PI * (J - 81) / 364.0;
+    const double EoT =
+        9.87 * polySin(2.0 * B) - 7.53 * polyCos(B) - 1.5 * polySin(B);
+    const double lst = hour[i] + (lon_deg[i] * 4.0 + EoT) / 60.0;
+    const double H = (15.0 * (lst - 12.0)) * DEG2RAD;
+    const double delta =
+        23.45 * DEG2RAD * polySin(2.0 * PI * (284.0 + J) / 365.0);
+    const double lat = lat_deg[i] * DEG2RAD;
+    const double mu0 = polySin(lat) * polySin(delta) +
+                       polyCos(lat) * polyCos(delta) * polyCos(H);
+    const double E0 = 1.0 + 0.033 * polyCos(2.0 * PI * J / 365.0);
+    // 1 in daylight on a valid day, else 0; a multiply rather than a select
+    const double lit = (mu0 > 0.0) & (J >= 1.0);
+    g0h[i] = lit * I_sc * E0 * mu0;
+  }
+}
+
+// ------------------ Memoized irradiance ------------------
+
+// All TOA irradiances one station can need: G0h for every day of the year
+// and UTC hour, and the yearly mean per hour for common and leap years.
+// Built once per station by the batch kernel (24 * 366 evaluations), after
+// which irradiance() and mean() are lookups. The values agree with those of
+// toaHorizontalIrradiance_Wm2 and meanToaIrradiance_Wm2_sameHour within
+// kBatchIrradianceTolerance_Wm2.
+//
+// IrradianceTable table(lon, lat);
+// double G0h = table.irradiance(year, month, day, hour);
+// double G0h_mean = table.mean(year, hour);
+class IrradianceTable {
+ private:
+  double m_lon_deg, m_lat_deg;
+  double m_g0h[367][24];  // [day of year][UTC hour], day 0 is unused
+  double m_mean[2][24];   // [leap][UTC hour]
+
+ public:
+  IrradianceTable(double lon_deg, double lat_deg)
+      : m_lon_deg{lon_deg}, m_lat_deg{lat_deg} {
+    constexpr std::size_t n = 366 * 24;
+    std::vector<int> doy(n), hour(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      doy[i] = static_cast<int>(i / 24) + 1;
+      hour[i] = static_cast<int>(i % 24);
+    }
+    const std::vector<double> lon(n, lon_deg), lat(n, lat_deg);
+    for (int h = 0; h < 24; ++h) m_g0h[0][h] = 0.0;
+    toaHorizontalIrradianceBatch(doy.data(), hour.data(), lon.data(),
+                                 lat.data(), &m_g0h[1][0], n);
+    for (int h = 0; h < 24; ++h) {
+      double sum = 0.0;
+      for (int J = 1; J <= 365; ++J) sum += m_g0h[J][h];
+      m_mean[0][h] = sum / 365;
+      m_mean[1][h] = (sum + m_g0h[366][h]) / 366;
+    }
+  }
+
+  double lon() const { return m_lon_deg; }
+  double lat() const { return m_lat_deg; }
+  bool isFor(double lon_deg, double lat_deg) const {
+    return lon_deg == m_lon_deg && lat_deg == m_lat_deg;
+  }
+
+  // G0h [W/m^2], 0 for an invalid date
+  double irradiance(int year, int month, int day, int hourUTC) const {
+    if (hourUTC < 0 || hourUTC > 23)
+      return toaHorizontalIrradiance_Wm2(year, month, day, hourUTC, m_lon_deg,
+                                         m_lat_deg);
+    const int J = dayOfYear(year, month, day);
+    return J < 1 ? 0.0 : m_g0h[J][hourUTC];
+  }
+
+  double mean(int year, int hourUTC) const {
+    if (hourUTC < 0 || hourUTC > 23)
+      return meanToaIrradiance_Wm2_sameHour(year, hourUTC, m_lon_deg,
+                                            m_lat_deg);
+    return m_mean[isLeap(year)][hourUTC];
+  }
+};
+
+// ------------------ Solar/ text rows ------------------
+
+// One row of the Solar/ subset written by build/clean. Lines without seven
+// numeric fields give false.
+inline bool parseSolarLine(const std::string& line, int& year, int& month,
+                           int& day, int& hour, double& tempC, double& lat,
+                           double& lon) {
+  // Format: year;month;day;hour;temperature;latitude;longitude
+  // Example: 1944;07;09;13;30.6;59.9000;17.5930
+  std::stringstream ss(line);
+  std::string tok;
+  std::vector<std::string> tokens;
+  while (std::getline(ss, tok, ';')) tokens.push_back(tok);
+  if (tokens.size() != 7) return false;
+
+  try {
+    year = std::stoi(tokens[0]);
+    month = std::stoi(tokens[1]);
+    day = std::stoi(tokens[2]);
+    hour = std::stoi(tokens[3]);
+    tempC = std::stod(tokens[4]);
+    lat = std::stod(tokens[5]);
+    lon = std::stod(tokens[6]);
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
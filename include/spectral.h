@@ -0,0 +1,262 @@
+#ifndef SPECTRAL_H
+#define SPECTRAL_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+// Power spectra of temperature series that may have gaps.
+//
+// welchPeriodogram: evenly sampled series, missing samples as NaN. The
+//   series is cut into half-overlapping Hann-windowed segments and the
+//   periodograms of the segments without a gap are averaged.
+// lombScargle: arbitrary sample times, so gaps need no filling at all.
+//   Uses the Press & Rybicki (1989) method: the samples are extirpolated
+//   onto a regular grid and the trigonometric sums come from two FFTs,
+//   O(N log N) instead of O(N * frequencies).
+//
+// Frequencies are in cycles per unit of the time axis (cycles per year if
+// the times are fractional years).
+
+struct Spectrum {
+  std::vector<double> frequency;
+  std::vector<double> power;
+};
+
+namespace spectral {
+
+constexpr double kPi = 3.14159265358979323846;
+
+inline std::size_t nextPowerOfTwo(std::size_t n) {
+  std::size_t p = 1;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+// Largest power of two <= n, 1 for n = 0
+inline std::size_t previousPowerOfTwo(std::size_t n) {
+  std::size_t p = 1;
+  while (p <= n / 2) p <<= 1;
+  return p;
+}
+
+// In-place iterative radix-2 FFT, X[k] = sum_m x[m] exp(-2 pi i k m / N).
+// data.size() must be a power of two.
+inline void fft(std::vector<std::complex<double>>& data) {
+  const std::size_t n = data.size();
+  for (std::size_t i = 1, j = 0; i < n; ++i) {
+    std::size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) std::swap(data[i], data[j]);
+  }
+  for (std::size_t len = 2; len <= n; len <<= 1) {
+    const double angle = -2.0 * kPi / static_cast<double>(len);
+    const std::complex<double> step(std::cos(angle), std::sin(angle));
+    for (std::size_t start = 0; start < n; start += len) {
+      std::complex<double> w(1.0, 0.0);
+      for (std::size_t k = 0; k < len / 2; ++k) {
+        const std::complex<double> a = data[start + k];
+        const std::complex<double> b = data[start + k + len / 2] * w;
+        data[start + k] = a + b;
+        data[start + k + len / 2] = a - b;
+        w *= step;
+      }
+    }
+  }
+}
+
+// Adds y at fractional position x of grid (0 <= x < grid.size()) by
+// Lagrange extirpolation over the m nearest points, so that sums of
+// periodic functions over the grid approximate those at the exact x.
+inline void extirpolate(double y, double x, std::vector<double>& grid,
+                        int m) {
+  static const double factorial[] = {1,   1,    2,     6,      24,
+                                     120, 720,  5040,  40320,  362880};
+  const long n = static_cast<long>(grid.size());
+  const long ix = static_cast<long>(x);
+  if (x == static_cast<double>(ix)) {
+    grid[ix] += y;
+    return;
+  }
+  const long lo =
+      std::min(std::max(static_cast<long>(x - 0.5 * m + 1.0), 0L), n - m);
+  const long hi = lo + m - 1;
+  double fac = x - lo;
+  for (long j = lo + 1; j <= hi; ++j) fac *= x - j;
+  // den = prod_{k != j} (j - k) over the m points, updated from j = hi down
+  double den = factorial[m - 1];
+  grid[hi] += y * fac / (den * (x - hi));
+  for (long j = hi - 1; j >= lo; --j) {
+    den = den / static_cast<double>(j + 1 - lo) * static_cast<double>(j - hi);
+    grid[j] += y * fac / (den * (x - j));
+  }
+}
+
+}  // namespace spectral
+
+// Welch power spectral density estimate of an evenly sampled series with
+// `sample_rate` samples per time unit. NaN samples are gaps. Segments are
+// `segment_length` samples, or the length of a shorter series, rounded
+// down to a power of two; those that contain a gap are skipped. Returns an
+// empty spectrum if no segment is complete.
+inline Spectrum welchPeriodogram(const std::vector<double>& series,
+                                 double sample_rate,
+                                 std::size_t segment_length) {
+  Spectrum result;
+  const std::size_t L = spectral::previousPowerOfTwo(std::max<std::size_t>(
+      2, std::min(segment_length, series.size())));
+  if (series.size() < L) return result;
+
+  std::vector<double> window(L);
+  double window_power = 0;
+  for (std::size_t i = 0; i < L; ++i) {
+    window[i] = 0.5 - 0.5 * std::cos(2.0 * spectral::kPi * i / (L - 1));
+    window_power += window[i] * window[i];
+  }
+
+  std::vector<double> psd(L / 2 + 1, 0.0);
+  std::vector<std::complex<double>> buffer(L);
+  std::size_t segments = 0;
+  for (std::size_t start = 0; start + L <= series.size(); start += L / 2) {
+    const auto first = series.begin() + start;
+    if (std::any_of(first, first + L, [](double v) { return std::isnan(v); }))
+      continue;
+    double mean = 0;
+    for (std::size_t i = 0; i < L; ++i) mean += first[i];
+    mean /= L;
+    for (std::size_t i = 0; i < L; ++i)
+      buffer[i] = std::complex<double>((first[i] - mean) * window[i], 0.0);
+    spectral::fft(buffer);
+    for (std::size_t k = 0; k <= L / 2; ++k) {
+      // One-sided density: the bins other than DC and Nyquist count twice
+      const double scale = (k == 0 || k == L / 2) ? 1.0 : 2.0;
+      psd[k] += scale * std::norm(buffer[k]) / (sample_rate * window_power);
+    }
+    ++segments;
+  }
+  if (segments == 0) return result;
+
+  result.frequency.resize(L / 2 + 1);
+  result.power.resize(L / 2 + 1);
+  for (std::size_t k = 0; k <= L / 2; ++k) {
+    result.frequency[k] = k * sample_rate / L;
+    result.power[k] = psd[k] / segments;
+  }
+  return result;
+}
+
+// Normalized Lomb-Scargle periodogram of samples y[i] at times t[i],
+// evaluated directly, O(N * frequencies). The reference for lombScargle().
+inline Spectrum lombScargleDirect(const std::vector<double>& t,
+                                  const std::vector<double>& y,
+                                  const std::vector<double>& frequencies) {
+  Spectrum result;
+  const std::size_t n = std::min(t.size(), y.size());
+  if (n < 2) return result;
+  double mean = 0, var = 0;
+  for (std::size_t i = 0; i < n; ++i) mean += y[i];
+  mean /= n;
+  for (std::size_t i = 0; i < n; ++i) var += (y[i] - mean) * (y[i] - mean);
+  var /= n - 1;
+  if (var <= 0) return result;
+
+  result.frequency = frequencies;
+  result.power.reserve(frequencies.size());
+  for (double f : frequencies) {
+    const double w = 2.0 * spectral::kPi * f;
+    double s2 = 0, c2 = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      s2 += std::sin(2.0 * w * t[i]);
+      c2 += std::cos(2.0 * w * t[i]);
+    }
+    const double tau = std::atan2(s2, c2) / (2.0 * w);
+    double yc = 0, ys = 0, cc = 0, ss = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      const double c = std::cos(w * (t[i] - tau));
+      const double s = std::sin(w * (t[i] - tau));
+      yc += (y[i] - mean) * c;
+      ys += (y[i] - mean) * s;
+      cc += c * c;
+      ss += s * s;
+    }
+    result.power.push_back((yc * yc / cc + ys * ys / ss) / (2.0 * var));
+  }
+  return result;
+}
+
+// Fast normalized Lomb-Scargle periodogram of samples y[i] at times t[i]
+// (any order, any spacing). Frequencies are spaced 1 / (oversampling * T)
+// for a time span T, up to max_frequency (default: the average Nyquist
+// frequency N / 2T). Agrees with lombScargleDirect() to about 1e-4 of the
+// peak power.
+inline Spectrum lombScargle(const std::vector<double>& t,
+                            const std::vector<double>& y,
+                            double oversampling = 4.0,
+                            double max_frequency = 0.0) {
+  constexpr int kPoints = 4;  // extirpolation order
+  Spectrum result;
+  const std::size_t n = std::min(t.size(), y.size());
+  if (n < 2) return result;
+
+  const auto [tmin_it, tmax_it] =
+      std::minmax_element(t.begin(), t.begin() + n);
+  const double tmin = *tmin_it;
+  const double span = *tmax_it - tmin;
+  if (span <= 0) return result;
+  double mean = 0, var = 0;
+  for (std::size_t i = 0; i < n; ++i) mean += y[i];
+  mean /= n;
+  for (std::size_t i = 0; i < n; ++i) var += (y[i] - mean) * (y[i] - mean);
+  var /= n - 1;
+  if (var <= 0) return result;
+
+  const double df = 1.0 / (span * oversampling);
+  if (max_frequency <= 0) max_frequency = 0.5 * n / span;
+  const std::size_t nout = static_cast<std::size_t>(max_frequency / df);
+  if (nout == 0) return result;
+
+  // The grid must resolve twice the highest frequency with room for the
+  // extirpolation error to stay small
+  const std::size_t ngrid = spectral::nextPowerOfTwo(
+      std::max<std::size_t>(64, 4 * kPoints * nout));
+  const double fngrid = static_cast<double>(ngrid);
+  const double fac = fngrid * df;  // grid cells per time unit
+  std::vector<double> grid_y(ngrid, 0.0), grid_1(ngrid, 0.0);
+  for (std::size_t i = 0; i < n; ++i) {
+    const double x = std::fmod((t[i] - tmin) * fac, fngrid);
+    spectral::extirpolate(y[i] - mean, x, grid_y, kPoints);
+    spectral::extirpolate(1.0, std::fmod(2.0 * x, fngrid), grid_1, kPoints);
+  }
+
+  std::vector<std::complex<double>> fy(grid_y.begin(), grid_y.end());
+  std::vector<std::complex<double>> f1(grid_1.begin(), grid_1.end());
+  spectral::fft(fy);
+  spectral::fft(f1);
+
+  result.frequency.reserve(nout);
+  result.power.reserve(nout);
+  for (std::size_t j = 1; j <= nout; ++j) {
+    // Bin j of the FFTs holds sum y cos(w t) and -sum y sin(w t) at w = 2 pi
+    // j df, and the same sums of 1 at twice that frequency
+    const double c1 = fy[j].real(), s1 = -fy[j].imag();
+    const double c2 = f1[j].real(), s2 = -f1[j].imag();
+    const double hypo = std::max(std::hypot(c2, s2), 1e-300);
+    const double hc2wt = 0.5 * c2 / hypo;
+    const double hs2wt = 0.5 * s2 / hypo;
+    const double cwt = std::sqrt(0.5 + hc2wt);
+    const double swt =
+        std::copysign(std::sqrt(std::max(0.0, 0.5 - hc2wt)), hs2wt);
+    const double den = 0.5 * n + hc2wt * c2 + hs2wt * s2;
+    const double cterm = (cwt * c1 + swt * s1) * (cwt * c1 + swt * s1) / den;
+    const double sterm =
+        (cwt * s1 - swt * c1) * (cwt * s1 - swt * c1) / (n - den);
+    result.frequency.push_back(j * df);
+    result.power.push_back((cterm + sterm) / (2.0 * var));
+  }
+  return result;
+}
+
+#endif /* SPECTRAL_H */
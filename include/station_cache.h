@@ -0,0 +1,289 @@
+#ifndef STATION_CACHE_H
+#define STATION_CACHE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Binary columnar cache of one station's observations, written by
+// build/clean to datasets/cache/<City>.col. Every observation of the raw file
+// is kept (not only quality G), one typed column per field, so the analysis
+// stages can memory-map the file and loop over plain arrays instead of
+// parsing text again.
+//
+// Layout: a fixed StationCacheHeader followed by the columns, each starting
+// on an 8 byte boundary at the offset recorded in the header:
+//   year int16, month uint8, day uint8, hour uint8 (UTC),
+//   temperature float (deg C), quality char (SMHI code, 'G' = good)
+// and one ZoneMap per block of kZoneRows rows. Files of any other version
+// are rejected; build/clean rewrites them.
+
+// Rows per zone map block. Filter::select evaluates rows in batches of the
+// same size, so a block that cannot match is skipped without reading it.
+constexpr std::size_t kZoneRows = 1024;
+
+// Value ranges of one block of rows: a query whose clauses miss the ranges
+// (years, months, hours, temperatures) can skip the whole block. time is
+// YYYYMMDDHH, e.g. 1990070112.
+struct ZoneMap {
+  std::int32_t time_min, time_max;
+  float temperature_min, temperature_max;
+  std::uint16_t rows;  // rows in the block, kZoneRows except for the last
+  std::uint16_t good;  // rows of quality G
+  std::uint8_t hour_min, hour_max;
+  std::uint8_t month_min, month_max;
+};
+
+inline std::int32_t zoneTime(int year, int month, int day, int hour) {
+  return ((year * 100 + month) * 100 + day) * 100 + hour;
+}
+
+// Non-owning view of a station's columns, either of a mapped cache file or
+// of a StationColumns in memory. All arrays have `rows` entries.
+struct StationView {
+  std::string_view name;
+  double latitude = 0;
+  double longitude = 0;
+  std::size_t rows = 0;
+  const std::int16_t* year = nullptr;
+  const std::uint8_t* month = nullptr;
+  const std::uint8_t* day = nullptr;
+  const std::uint8_t* hour = nullptr;
+  const float* temperature = nullptr;
+  const char* quality = nullptr;
+  // Block i covers rows [i * kZoneRows, (i + 1) * kZoneRows). Null for
+  // views without zone maps, which are then read in full.
+  const ZoneMap* zones = nullptr;
+
+  bool good(std::size_t i) const { return quality[i] == 'G'; }
+  std::size_t blocks() const { return (rows + kZoneRows - 1) / kZoneRows; }
+};
+
+// The zone maps of every block of `v`
+inline std::vector<ZoneMap> computeZoneMaps(const StationView& v) {
+  std::vector<ZoneMap> zones(v.blocks());
+  for (std::size_t b = 0; b < zones.size(); ++b) {
+    const std::size_t begin = b * kZoneRows;
+    const std::size_t end = std::min(begin + kZoneRows, v.rows);
+    ZoneMap& z = zones[b];
+    z.time_min = z.time_max = zoneTime(v.year[begin], v.month[begin],
+                                       v.day[begin], v.hour[begin]);
+    z.temperature_min = z.temperature_max = v.temperature[begin];
+    z.hour_min = z.hour_max = v.hour[begin];
+    z.month_min = z.month_max = v.month[begin];
+    z.rows = static_cast<std::uint16_t>(end - begin);
+    z.good = 0;
+    for (std::size_t i = begin; i < end; ++i) {
+      const std::int32_t t =
+          zoneTime(v.year[i], v.month[i], v.day[i], v.hour[i]);
+      z.time_min = std::min(z.time_min, t);
+      z.time_max = std::max(z.time_max, t);
+      z.temperature_min = std::min(z.temperature_min, v.temperature[i]);
+      z.temperature_max = std::max(z.temperature_max, v.temperature[i]);
+      z.hour_min = std::min(z.hour_min, v.hour[i]);
+      z.hour_max = std::max(z.hour_max, v.hour[i]);
+      z.month_min = std::min(z.month_min, v.month[i]);
+      z.month_max = std::max(z.month_max, v.month[i]);
+      z.good += v.good(i);
+    }
+  }
+  return zones;
+}
+
+// Columns of a station being built in memory, e.g. while cleaning
+struct StationColumns {
+  std::string name;
+  double latitude = 0;
+  double longitude = 0;
+  std::vector<std::int16_t> year;
+  std::vector<std::uint8_t> month, day, hour;
+  std::vector<float> temperature;
+  std::vector<char> quality;
+
+  void add(int y, int m, int d, int h, float t, char q) {
+    year.push_back(static_cast<std::int16_t>(y));
+    month.push_back(static_cast<std::uint8_t>(m));
+    day.push_back(static_cast<std::uint8_t>(d));
+    hour.push_back(static_cast<std::uint8_t>(h));
+    temperature.push_back(t);
+    quality.push_back(q);
+  }
+
+  std::size_t size() const { return year.size(); }
+
+  StationView view() const {
+    StationView v;
+    v.name = name;
+    v.latitude = latitude;
+    v.longitude = longitude;
+    v.rows = size();
+    v.year = year.data();
+    v.month = month.data();
+    v.day = day.data();
+    v.hour = hour.data();
+    v.temperature = temperature.data();
+    v.quality = quality.data();
+    return v;
+  }
+};
+
+struct StationCacheHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t header_size;
+  std::uint64_t rows;
+  double latitude;
+  double longitude;
+  char name[64];
+  std::uint64_t offset_year;
+  std::uint64_t offset_month;
+  std::uint64_t offset_day;
+  std::uint64_t offset_hour;
+  std::uint64_t offset_temperature;
+  std::uint64_t offset_quality;
+  std::uint64_t offset_zones;
+  std::uint64_t zone_rows;
+};
+
+constexpr char kStationCacheMagic[8] = {'M', 'N', 'X', 'B', 'C', 'O', 'L', '\0'};
+constexpr std::uint32_t kStationCacheVersion = 2;
+
+// datasets/cache/Lund.col for ("datasets/cache", "Lund")
+inline std::string stationCachePath(const std::string& dir,
+                                    const std::string& city) {
+  return dir + "/" + city + ".col";
+}
+
+inline std::uint64_t alignTo8(std::uint64_t n) { return (n + 7) & ~7ull; }
+
+// Writes `cols` as a cache file. Returns false if the file cannot be written.
+inline bool writeStationCache(const std::string& path,
+                              const StationColumns& cols) {
+  const std::uint64_t n = cols.size();
+  const std::vector<ZoneMap> zones = computeZoneMaps(cols.view());
+  StationCacheHeader h{};
+  std::memcpy(h.magic, kStationCacheMagic, sizeof h.magic);
+  h.version = kStationCacheVersion;
+  h.header_size = sizeof(StationCacheHeader);
+  h.rows = n;
+  h.latitude = cols.latitude;
+  h.longitude = cols.longitude;
+  std::strncpy(h.name, cols.name.c_str(), sizeof h.name - 1);
+
+  std::uint64_t off = alignTo8(sizeof h);
+  auto place = [&](std::uint64_t& field, std::uint64_t bytes) {
+    field = off;
+    off = alignTo8(off + bytes);
+  };
+  place(h.offset_year, n * sizeof(std::int16_t));
+  place(h.offset_month, n);
+  place(h.offset_day, n);
+  place(h.offset_hour, n);
+  place(h.offset_temperature, n * sizeof(float));
+  place(h.offset_quality, n);
+  place(h.offset_zones, zones.size() * sizeof(ZoneMap));
+  h.zone_rows = kZoneRows;
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out) return false;
+  std::uint64_t pos = 0;
+  auto put = [&](std::uint64_t at, const void* data, std::uint64_t bytes) {
+    static const char zeros[8] = {};
+    out.write(zeros, static_cast<std::streamsize>(at - pos));
+    out.write(static_cast<const char*>(data),
+              static_cast<std::streamsize>(bytes));
+    pos = at + bytes;
+  };
+  put(0, &h, sizeof h);
+  put(h.offset_year, cols.year.data(), n * sizeof(std::int16_t));
+  put(h.offset_month, cols.month.data(), n);
+  put(h.offset_day, cols.day.data(), n);
+  put(h.offset_hour, cols.hour.data(), n);
+  put(h.offset_temperature, cols.temperature.data(), n * sizeof(float));
+  put(h.offset_quality, cols.quality.data(), n);
+  put(h.offset_zones, zones.data(), zones.size() * sizeof(ZoneMap));
+  return static_cast<bool>(out);
+}
+
+// A memory-mapped cache file. view() points straight into the mapping, no
+// column is copied.
+//
+// StationCache cache{stationCachePath("datasets/cache", "Lund")};
+// if (cache.is_open()) {
+//   const StationView& v = cache.view();
+//   for (std::size_t i = 0; i < v.rows; ++i)
+//     if (v.good(i)) use(v.year[i], v.temperature[i]);
+// }
+class StationCache {
+ private:
+  MappedFile m_file;
+  StationView m_view;
+  std::string m_error;
+
+  template <typename T>
+  const T* column(std::uint64_t offset, std::uint64_t rows) {
+    if (offset % alignof(T) != 0 || offset + rows * sizeof(T) > m_file.size())
+      return nullptr;
+    return reinterpret_cast<const T*>(m_file.data() + offset);
+  }
+
+ public:
+  StationCache() = default;
+
+  explicit StationCache(const std::string& path) : m_file{path} {
+    if (!m_file.is_open()) {
+      m_error = "cannot open " + path;
+      return;
+    }
+    if (m_file.size() < sizeof(StationCacheHeader)) {
+      m_error = path + " is too small to be a station cache";
+      return;
+    }
+    const auto* h = reinterpret_cast<const StationCacheHeader*>(m_file.data());
+    if (std::memcmp(h->magic, kStationCacheMagic, sizeof h->magic) != 0 ||
+        h->version != kStationCacheVersion ||
+        h->header_size != sizeof(StationCacheHeader) ||
+        h->zone_rows != kZoneRows) {
+      m_error = path + " is not a version " +
+                std::to_string(kStationCacheVersion) +
+                " station cache, rerun build/clean";
+      return;
+    }
+
+    StationView v;
+    v.name = std::string_view(h->name, strnlen(h->name, sizeof h->name));
+    v.latitude = h->latitude;
+    v.longitude = h->longitude;
+    v.rows = h->rows;
+    v.year = column<std::int16_t>(h->offset_year, h->rows);
+    v.month = column<std::uint8_t>(h->offset_month, h->rows);
+    v.day = column<std::uint8_t>(h->offset_day, h->rows);
+    v.hour = column<std::uint8_t>(h->offset_hour, h->rows);
+    v.temperature = column<float>(h->offset_temperature, h->rows);
+    v.quality = column<char>(h->offset_quality, h->rows);
+    if (!v.year || !v.month || !v.day || !v.hour || !v.temperature ||
+        !v.quality) {
+      m_error = path + " is truncated";
+      return;
+    }
+    v.zones = column<ZoneMap>(h->offset_zones, v.blocks());
+    if (!v.zones) {
+      m_error = path + " is truncated";
+      return;
+    }
+    m_view = v;
+  }
+
+  bool is_open() const { return m_error.empty() && m_file.is_open(); }
+  const std::string& error() const { return m_error; }
+  const StationView& view() const { return m_view; }
+};
+
+#endif /* STATION_CACHE_H */
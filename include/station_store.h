@@ -0,0 +1,73 @@
+#ifndef STATION_STORE_H
+#define STATION_STORE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "station_cache.h"
+
+// Station columns kept in memory by the pipeline driver (main.cxx) between
+// its stages. The clean stage puts every station it reads here, and the
+// stages after it look a station up before they map its cache file, so a
+// run of several stages reads the raw data once. The separate tools never
+// enable the store; for them find() always returns null.
+struct StoredStation {
+  StationColumns columns;
+  std::vector<ZoneMap> zones;
+
+  StationView view() const {
+    StationView v = columns.view();
+    v.zones = zones.data();
+    return v;
+  }
+};
+
+class StationStore {
+ private:
+  mutable std::mutex m_mutex;
+  std::map<std::string, std::shared_ptr<const StoredStation>> m_stations;
+  bool m_enabled = false;
+
+ public:
+  // The store of this process
+  static StationStore& instance() {
+    static StationStore store;
+    return store;
+  }
+
+  // Call before any stage runs; the flag is not synchronized
+  void enable() { m_enabled = true; }
+  bool enabled() const { return m_enabled; }
+
+  // Takes over `columns`, replacing a station of the same name. Safe to call
+  // from several threads.
+  void put(StationColumns columns) {
+    if (!m_enabled) return;
+    auto station = std::make_shared<StoredStation>();
+    station->columns = std::move(columns);
+    station->zones = computeZoneMaps(station->columns.view());
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stations[station->columns.name] = std::move(station);
+  }
+
+  std::shared_ptr<const StoredStation> find(const std::string& name) const {
+    if (!m_enabled) return nullptr;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_stations.find(name);
+    return it == m_stations.end() ? nullptr : it->second;
+  }
+
+  // Sorted station names
+  std::vector<std::string> names() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> names;
+    for (const auto& entry : m_stations) names.push_back(entry.first);
+    return names;
+  }
+};
+
+#endif /* STATION_STORE_H */
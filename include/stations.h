@@ -0,0 +1,321 @@
+#ifndef STATIONS_H
+#define STATIONS_H
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "parse_utils.h"
+
+// The station registry and a spatial index over it.
+//
+// build/clean writes datasets/stations.csv with one line per station,
+//   station;latitude;longitude;rows;first_year;last_year
+// (the last position of the station and the span of its quality G rows).
+// StationIndex is a 2-d tree over the (latitude, longitude) of the
+// registry. It answers the k nearest stations to a point by great-circle
+// distance and the stations in a bounding box or latitude band in
+// O(log n + matches), so a regional analysis only opens the files of the
+// stations it selects.
+//
+// std::vector<StationInfo> stations;
+// readStationRegistry("datasets/stations.csv", stations);
+// StationIndex index(stations);
+// for (const auto& n : index.nearest(55.7, 13.2, 3))
+//   std::cout << stations[n.index].name << " " << n.distance_km << "\n";
+// index.inBox(55, 57, 12, 16);  // indices into `stations`, sorted
+
+struct StationInfo {
+  std::string name;
+  double latitude = std::numeric_limits<double>::quiet_NaN();
+  double longitude = std::numeric_limits<double>::quiet_NaN();
+  long rows = 0;
+  int first_year = 0, last_year = 0;
+};
+
+inline bool writeStationRegistry(const std::string& path,
+                                 const std::vector<StationInfo>& stations) {
+  std::ofstream out(path);
+  if (!out) return false;
+  out << "station;latitude;longitude;rows;first_year;last_year\n";
+  out.precision(10);
+  for (const StationInfo& s : stations)
+    out << s.name << ";" << s.latitude << ";" << s.longitude << ";" << s.rows
+        << ";" << s.first_year << ";" << s.last_year << "\n";
+  return static_cast<bool>(out);
+}
+
+// Appends the stations of a registry file, skipping the header and lines
+// that do not parse. Returns false if the file cannot be read.
+inline bool readStationRegistry(const std::string& path,
+                                std::vector<StationInfo>& stations) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::string line;
+  std::string_view f[6];
+  while (std::getline(in, line)) {
+    StationInfo s;
+    if (splitFields(line, ';', f, 6) != 6 || !parseDouble(f[1], s.latitude) ||
+        !parseDouble(f[2], s.longitude))
+      continue;
+    s.name = std::string(f[0]);
+    long rows = 0;
+    int first = 0, last = 0;
+    if (parseInt(f[4], first) && parseInt(f[5], last)) {
+      s.first_year = first;
+      s.last_year = last;
+    }
+    std::string_view r = numberPrefix(f[3]);
+    if (std::from_chars(r.data(), r.data() + r.size(), rows).ec == std::errc())
+      s.rows = rows;
+    stations.push_back(std::move(s));
+  }
+  return true;
+}
+
+constexpr double kEarthRadiusKm = 6371.0;
+
+inline double greatCircleKm(double lat1, double lon1, double lat2,
+                            double lon2) {
+  constexpr double rad = 3.14159265358979323846 / 180.0;
+  const double dlat = (lat2 - lat1) * rad, dlon = (lon2 - lon1) * rad;
+  const double a = std::sin(dlat / 2) * std::sin(dlat / 2) +
+                   std::cos(lat1 * rad) * std::cos(lat2 * rad) *
+                       std::sin(dlon / 2) * std::sin(dlon / 2);
+  return 2 * kEarthRadiusKm * std::asin(std::min(1.0, std::sqrt(a)));
+}
+
+class StationIndex {
+ public:
+  struct Neighbour {
+    std::size_t index;  // into the stations the index was built from
+    double distance_km;
+  };
+
+ private:
+  struct Point {
+    double coord[2];  // latitude, longitude
+    std::size_t index;
+  };
+  // Implicit tree: the node of [begin, end) is the median at the middle, its
+  // children are the two halves, and the split axis alternates with depth
+  std::vector<Point> m_points;
+
+  void build(std::size_t begin, std::size_t end, int axis) {
+    if (end - begin < 2) return;
+    const std::size_t mid = begin + (end - begin) / 2;
+    std::nth_element(m_points.begin() + begin, m_points.begin() + mid,
+                     m_points.begin() + end,
+                     [axis](const Point& a, const Point& b) {
+                       return a.coord[axis] < b.coord[axis];
+                     });
+    build(begin, mid, 1 - axis);
+    build(mid + 1, end, 1 - axis);
+  }
+
+  // Great-circle distance from (lat, lon) to anything on the far side of
+  // the split `value` on `axis`, as a lower bound
+  static double splitDistanceKm(double lat, double lon, int axis,
+                                double value) {
+    constexpr double rad = 3.14159265358979323846 / 180.0;
+    if (axis == 0) return kEarthRadiusKm * std::fabs(lat - value) * rad;
+    // Distance to the great circle of the meridian, valid within 90 degrees
+    const double dlon = std::fabs(lon - value) * rad;
+    if (dlon >= 0.5 * 3.14159265358979323846) return 0.0;
+    return kEarthRadiusKm *
+           std::asin(std::min(1.0, std::cos(lat * rad) * std::sin(dlon)));
+  }
+
+  // Keeps the k best in `best`, a max-heap on distance
+  void nearest(std::size_t begin, std::size_t end, int axis, double lat,
+               double lon, std::size_t k, std::vector<Neighbour>& best) const {
+    if (begin >= end) return;
+    const std::size_t mid = begin + (end - begin) / 2;
+    const Point& p = m_points[mid];
+    auto farther = [](const Neighbour& a, const Neighbour& b) {
+      return a.distance_km < b.distance_km;
+    };
+    const double d = greatCircleKm(lat, lon, p.coord[0], p.coord[1]);
+    if (best.size() < k || d < best.front().distance_km) {
+      if (best.size() == k) {
+        std::pop_heap(best.begin(), best.end(), farther);
+        best.pop_back();
+      }
+      best.push_back({p.index, d});
+      std::push_heap(best.begin(), best.end(), farther);
+    }
+
+    const double query = axis == 0 ? lat : lon;
+    const bool left_first = query < p.coord[axis];
+    const std::size_t near_b = left_first ? begin : mid + 1;
+    const std::size_t near_e = left_first ? mid : end;
+    const std::size_t far_b = left_first ? mid + 1 : begin;
+    const std::size_t far_e = left_first ? end : mid;
+    nearest(near_b, near_e, 1 - axis, lat, lon, k, best);
+    if (best.size() < k ||
+        splitDistanceKm(lat, lon, axis, p.coord[axis]) <
+            best.front().distance_km)
+      nearest(far_b, far_e, 1 - axis, lat, lon, k, best);
+  }
+
+  void inBox(std::size_t begin, std::size_t end, int axis, const double lo[2],
+             const double hi[2], std::vector<std::size_t>& out) const {
+    if (begin >= end) return;
+    const std::size_t mid = begin + (end - begin) / 2;
+    const Point& p = m_points[mid];
+    if (p.coord[0] >= lo[0] && p.coord[0] <= hi[0] && p.coord[1] >= lo[1] &&
+        p.coord[1] <= hi[1])
+      out.push_back(p.index);
+    if (lo[axis] <= p.coord[axis]) inBox(begin, mid, 1 - axis, lo, hi, out);
+    if (hi[axis] >= p.coord[axis]) inBox(mid + 1, end, 1 - axis, lo, hi, out);
+  }
+
+ public:
+  // Stations without a position are left out of the index
+  explicit StationIndex(const std::vector<StationInfo>& stations) {
+    for (std::size_t i = 0; i < stations.size(); ++i)
+      if (std::isfinite(stations[i].latitude) &&
+          std::isfinite(stations[i].longitude))
+        m_points.push_back({{stations[i].latitude, stations[i].longitude}, i});
+    build(0, m_points.size(), 0);
+  }
+
+  std::size_t size() const { return m_points.size(); }
+
+  // The k stations closest to (lat, lon), nearest first
+  std::vector<Neighbour> nearest(double lat, double lon, std::size_t k) const {
+    std::vector<Neighbour> best;
+    if (k == 0) return best;
+    best.reserve(k + 1);
+    nearest(0, m_points.size(), 0, lat, lon, k, best);
+    std::sort_heap(best.begin(), best.end(),
+                   [](const Neighbour& a, const Neighbour& b) {
+                     return a.distance_km < b.distance_km;
+                   });
+    return best;
+  }
+
+  // Stations with lat in [lat_lo, lat_hi] and lon in [lon_lo, lon_hi]
+  std::vector<std::size_t> inBox(double lat_lo, double lat_hi, double lon_lo,
+                                 double lon_hi) const {
+    const double lo[2] = {lat_lo, lon_lo}, hi[2] = {lat_hi, lon_hi};
+    std::vector<std::size_t> out;
+    inBox(0, m_points.size(), 0, lo, hi, out);
+    std::sort(out.begin(), out.end());
+    return out;
+  }
+
+  std::vector<std::size_t> inLatitudeBand(double lat_lo, double lat_hi) const {
+    return inBox(lat_lo, lat_hi, -180.0, 180.0);
+  }
+};
+
+// A station selection given on the command line of a tool:
+//   --near LAT,LON [-k N]        the N (default 5) nearest stations
+//   --box LAT0,LAT1,LON0,LON1    stations in a bounding box
+//   --band LAT0,LAT1             stations in a latitude band
+class StationSelection {
+ public:
+  enum class Kind { All, Near, Box, Band };
+
+  static constexpr const char* kUsage =
+      "[--near LAT,LON [-k N] | --box LAT0,LAT1,LON0,LON1 | --band LAT0,LAT1]";
+
+ private:
+  Kind m_kind = Kind::All;
+  double m_v[4] = {0, 0, 0, 0};
+  std::size_t m_k = 5;
+
+  static bool parseList(std::string_view s, double* out, int n) {
+    std::string_view f[4];
+    if (splitFields(s, ',', f, 4) != n) return false;
+    for (int i = 0; i < n; ++i)
+      if (!parseDouble(f[i], out[i])) return false;
+    return true;
+  }
+
+ public:
+  Kind kind() const { return m_kind; }
+  bool active() const { return m_kind != Kind::All; }
+  std::size_t k() const { return m_k; }
+  const double* values() const { return m_v; }
+
+  // Consumes argv[i] (and its value) if it is a selection option. Returns
+  // false if it is not one; sets `error` if it is one but malformed.
+  bool parseArg(int& i, int argc, char* argv[], std::string& error) {
+    const std::string_view arg = argv[i];
+    if (arg != "--near" && arg != "--box" && arg != "--band" && arg != "-k")
+      return false;
+    if (i + 1 >= argc) {
+      error = std::string(arg) + " needs a value";
+      return true;
+    }
+    const std::string_view value = argv[++i];
+    bool ok = true;
+    if (arg == "-k") {
+      int k = 0;
+      ok = parseInt(value, k) && k > 0;
+      m_k = static_cast<std::size_t>(std::max(k, 1));
+    } else if (arg == "--near") {
+      m_kind = Kind::Near;
+      ok = parseList(value, m_v, 2);
+    } else if (arg == "--box") {
+      m_kind = Kind::Box;
+      ok = parseList(value, m_v, 4);
+    } else {
+      m_kind = Kind::Band;
+      ok = parseList(value, m_v, 2);
+    }
+    if (!ok) error = "Bad value for " + std::string(arg) + ": " +
+                     std::string(value);
+    return true;
+  }
+
+  // Indices into the stations of `index`, nearest first for --near and in
+  // registry order otherwise
+  std::vector<std::size_t> select(const StationIndex& index) const {
+    std::vector<std::size_t> out;
+    switch (m_kind) {
+      case Kind::All:
+        break;
+      case Kind::Near:
+        for (const auto& n : index.nearest(m_v[0], m_v[1], m_k))
+          out.push_back(n.index);
+        break;
+      case Kind::Box:
+        out = index.inBox(std::min(m_v[0], m_v[1]), std::max(m_v[0], m_v[1]),
+                          std::min(m_v[2], m_v[3]), std::max(m_v[2], m_v[3]));
+        break;
+      case Kind::Band:
+        out = index.inLatitudeBand(std::min(m_v[0], m_v[1]),
+                                   std::max(m_v[0], m_v[1]));
+        break;
+    }
+    return out;
+  }
+
+  // Names of the selected stations of the registry at `registry_path`.
+  // Returns false with a message in `error` if the registry is unreadable.
+  bool selectNames(const std::string& registry_path,
+                   std::vector<std::string>& names, std::string& error) const {
+    std::vector<StationInfo> stations;
+    if (!readStationRegistry(registry_path, stations)) {
+      error = "Cannot read the station registry " + registry_path +
+              " (written by build/clean)";
+      return false;
+    }
+    const StationIndex index(stations);
+    for (std::size_t i : select(index)) names.push_back(stations[i].name);
+    return true;
+  }
+};
+
+#endif /* STATIONS_H */
@@ -0,0 +1,150 @@
+#ifndef TREND_H
+#define TREND_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Linear temperature trends in closed form, without ROOT. The trend plots
+// average the yearly values in a TProfile of 150 bins over 1850-2025 and
+// fit a straight line to the bin means, weighted by their errors. The same
+// chi-square has an exact minimum, so a handful of running sums give the
+// slope, the intercept and their errors directly.
+//
+// YearProfile profile;             // same bins as the plots' TProfile
+// for (...) profile.add(year, mean_temp);
+// TrendFit trend = profile.fit();
+// trend.slope * 100                // degrees per century
+
+// Result of a weighted straight-line fit y = intercept + slope * x
+struct TrendFit {
+  double slope = 0, slope_error = 0;
+  double intercept = 0, intercept_error = 0;
+  double chi2 = 0;
+  int points = 0;
+  bool ok = false;  // false with fewer than two distinct x
+};
+
+// Running sums of a weighted least-squares line fit. Points with sigma <= 0
+// are skipped, as ROOT's fit skips points without an error. x is taken
+// relative to the first point to keep the sums well conditioned.
+class TrendAccumulator {
+ private:
+  double m_x0 = 0;
+  double m_s = 0, m_sx = 0, m_sy = 0, m_sxx = 0, m_sxy = 0, m_syy = 0;
+  int m_n = 0;
+
+ public:
+  void add(double x, double y, double sigma) {
+    if (!(sigma > 0)) return;
+    if (m_n == 0) m_x0 = x;
+    const double w = 1.0 / (sigma * sigma);
+    const double dx = x - m_x0;
+    m_s += w;
+    m_sx += w * dx;
+    m_sy += w * y;
+    m_sxx += w * dx * dx;
+    m_sxy += w * dx * y;
+    m_syy += w * y * y;
+    ++m_n;
+  }
+
+  void merge(const TrendAccumulator& other) {
+    if (other.m_n == 0) return;
+    if (m_n == 0) {
+      *this = other;
+      return;
+    }
+    // Shift the other sums to this origin
+    const double d = other.m_x0 - m_x0;
+    m_s += other.m_s;
+    m_sx += other.m_sx + d * other.m_s;
+    m_sy += other.m_sy;
+    m_sxx += other.m_sxx + 2 * d * other.m_sx + d * d * other.m_s;
+    m_sxy += other.m_sxy + d * other.m_sy;
+    m_syy += other.m_syy;
+    m_n += other.m_n;
+  }
+
+  int points() const { return m_n; }
+
+  TrendFit fit() const {
+    TrendFit r;
+    r.points = m_n;
+    const double delta = m_s * m_sxx - m_sx * m_sx;
+    if (m_n < 2 || !(delta > 0)) return r;
+    const double b = (m_s * m_sxy - m_sx * m_sy) / delta;
+    const double a0 = (m_sxx * m_sy - m_sx * m_sxy) / delta;  // at x = x0
+    r.slope = b;
+    r.slope_error = std::sqrt(m_s / delta);
+    // Intercept at x = 0: a = a0 - b x0, var(a) from the covariance of a0, b
+    r.intercept = a0 - b * m_x0;
+    r.intercept_error = std::sqrt(std::max(
+        0.0, (m_sxx + 2 * m_x0 * m_sx + m_x0 * m_x0 * m_s) / delta));
+    r.chi2 = std::max(0.0, m_syy - a0 * m_sy - b * m_sxy);
+    r.ok = true;
+    return r;
+  }
+
+  // fit() of points added with one and the same sigma, standing in for
+  // unknown errors: the errors are scaled by the scatter of the points
+  // around the line, sqrt(chi2 / (points - 2)). Needs three points.
+  TrendFit fitToScatter() const {
+    TrendFit r = fit();
+    if (!r.ok) return r;
+    if (r.points < 3) {
+      r.ok = false;
+      return r;
+    }
+    const double scale = std::sqrt(r.chi2 / (r.points - 2));
+    r.slope_error *= scale;
+    r.intercept_error *= scale;
+    return r;
+  }
+};
+
+// The yearly TProfile of the trend plots: equal bins over [lo, hi), each
+// bin's mean and the error of that mean (spread / sqrt(entries), zero for a
+// single entry, as TProfile's default error option).
+class YearProfile {
+ private:
+  double m_lo, m_hi;
+  std::vector<double> m_sum, m_sum2;
+  std::vector<long> m_n;
+
+ public:
+  explicit YearProfile(int bins = 150, double lo = 1850, double hi = 2025)
+      : m_lo{lo}, m_hi{hi}, m_sum(bins), m_sum2(bins), m_n(bins) {}
+
+  int bins() const { return static_cast<int>(m_n.size()); }
+  double width() const { return (m_hi - m_lo) / bins(); }
+  double center(int i) const { return m_lo + (i + 0.5) * width(); }
+  long entries(int i) const { return m_n[i]; }
+  double mean(int i) const { return m_n[i] ? m_sum[i] / m_n[i] : 0.0; }
+  double error(int i) const {
+    if (m_n[i] == 0) return 0.0;
+    const double m = mean(i);
+    return std::sqrt(std::fabs(m_sum2[i] / m_n[i] - m * m) / m_n[i]);
+  }
+
+  // Values outside [lo, hi) go to TProfile's under/overflow, not used here
+  void add(double x, double y) {
+    if (!(x >= m_lo && x < m_hi)) return;
+    // Same arithmetic as TAxis::FindBin
+    int i = static_cast<int>(bins() * (x - m_lo) / (m_hi - m_lo));
+    if (i >= bins()) i = bins() - 1;
+    m_sum[i] += y;
+    m_sum2[i] += y * y;
+    ++m_n[i];
+  }
+
+  // Straight line through the bin means, as the plots' pol1 fit
+  TrendFit fit() const {
+    TrendAccumulator acc;
+    for (int i = 0; i < bins(); ++i)
+      if (m_n[i] > 0) acc.add(center(i), mean(i), error(i));
+    return acc.fit();
+  }
+};
+
+#endif /* TREND_H */
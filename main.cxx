@@ -1,15 +1,298 @@
-
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
 #include <iostream>
-int main(int argc, char *argv[]) {
-  std::cout << "I am just a code template, you need to implement the "
-               "functionality you want to use yourself!"
-            << std::endl;
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <TLegend.h>
+#include <TList.h>
+#include <TROOT.h>
+#include <TString.h>
+#include <TStyle.h>
+
+#include "instrument.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "station_store.h"
+
+// The birthday plot macro, compiled in like the climate macros of
+// src/plot_climate.cxx
+#include "plot_bdays.C"
+
+// Usage:
+// g++ -O2 -pthread -DPIPELINE_DRIVER -Iinclude -Isrc main.cxx src/clean.cxx
+//     src/climate.cxx src/sweden_average.cxx src/trends.cxx src/b-days.cxx
+//     src/csv_to_root.cxx src/solar.cxx src/plot_solar.cxx
+//     src/plot_climate.cxx src/serve.cxx src/filter.cxx
+//     $(root-config --cflags --libs)
+//     -o build/pipeline
+// ./build/pipeline COMMAND [options]
+//
+//   clean [raw_dir] [datasets_dir] [options]
+//                     build/clean; raw_dir defaults to $RAW_DIR, else
+//                     datasets/raw, which is extracted from $RAW_ARCHIVE
+//                     or raw/datasets.tgz first if it is missing or empty,
+//                     as bash/clean.sh does
+//   aggregate [options]
+//                     build/climate into datasets/Climate, without Halmstad
+//                     as in preprocess.sh
+//   national [options]
+//                     build/sweden_average, then build/trends; `all` passes
+//                     --smooth 10 as preprocess.sh does
+//   bdays             build/b-days and plot_bdays.C for every station
+//   solar [-j N]      solar.cxx and plot_solar.cxx
+//   plot [-j N]       build/csv_to_root on the datasets, then
+//                     build/plot_climate
+//   all [-j N] [--no-store]
+//                     every command above, in this order
+//   serve [options]   keeps every station in memory and answers trend,
+//                     aggregate, birthday and solar queries on a Unix
+//                     socket; ask [REQUEST ...] is its client (src/serve.cxx)
+//
+// Each command runs the stages of the same name in preprocess.sh and
+// run_all.sh, with the code of the separate tools, in this one process. The
+// options of clean, aggregate and national are those of the tools. `all`
+// keeps the stations read by clean in memory (station_store.h), so the
+// aggregate, bdays and solar stages neither map datasets/cache nor parse
+// text again, and ROOT starts once instead of once per macro and per
+// b-days city. --no-store leaves them on disk for runs larger than memory.
+// The yearly summaries still pass through datasets/Climate: they are outputs
+// of their own and a few kB per station.
+
+namespace fs = std::filesystem;
 
-  std::cout << "We were passed " << argc
-            << " command line arguments, the first of which was " << argv[0]
+// Calls the main of a tool with the command line `args`, args[0] being the
+// name it prints in its messages
+static int runTool(int (*tool)(int, char*[]), std::vector<std::string> args) {
+  std::vector<char*> argv;
+  for (std::string& arg : args) argv.push_back(arg.data());
+  argv.push_back(nullptr);
+  return tool(static_cast<int>(args.size()), argv.data());
+}
+
+// The gStyle settings rootlogon.C makes for the macros run with root -l,
+// without starting the interpreter
+static void useMacroStyle() {
+  gStyle->SetOptStat(0);
+  gStyle->SetOptTitle(0);
+  gStyle->SetTitleSize(0.05, "x");
+  gStyle->SetTitleSize(0.05, "y");
+  gStyle->SetLabelSize(0.05, "x");
+  gStyle->SetLabelSize(0.05, "y");
+  gStyle->SetPadTopMargin(0.05);
+  gStyle->SetPadRightMargin(0.05);
+  gStyle->SetPadBottomMargin(0.16);
+  gStyle->SetPadLeftMargin(0.16);
+}
+
+// Extracts the raw station archive into `dir` as bash/clean.sh does:
+// $RAW_ARCHIVE, else raw/datasets.tgz, without its .dat and .txt files
+static bool extractRaw(const fs::path& dir) {
+  const char* env = std::getenv("RAW_ARCHIVE");
+  const std::string archive = env && *env ? env : "raw/datasets.tgz";
+  if (!fs::is_regular_file(archive)) {
+    std::cerr << "No raw data: " << dir.string() << " is missing or empty and "
+              << archive << " does not exist" << std::endl;
+    return false;
+  }
+  fs::create_directories(dir);
+  std::cout << "Extracting " << archive << " into " << dir.string()
             << std::endl;
-  std::cout << "With a good CLI library, we could use the command line "
-               "arguments to make a useful program."
+  const pid_t pid = fork();
+  if (pid == 0) {
+    execlp("tar", "tar", "zxf", archive.c_str(), "-C", dir.c_str(),
+           static_cast<char*>(nullptr));
+    _exit(127);
+  }
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    std::cerr << "Could not extract " << archive << std::endl;
+    return false;
+  }
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(dir)) {
+    const fs::path ext = entry.path().extension();
+    if (ext == ".dat" || ext == ".txt") fs::remove(entry.path(), ec);
+  }
+  return true;
+}
+
+static int runClean(std::vector<std::string> args) {
+  if (args.empty() || args[0][0] == '-') {
+    const char* raw_dir = std::getenv("RAW_DIR");
+    if (raw_dir && *raw_dir) {
+      args.insert(args.begin(), {raw_dir, "datasets"});
+    } else {
+      const fs::path dir = "datasets/raw";
+      if ((!fs::is_directory(dir) || fs::is_empty(dir)) && !extractRaw(dir))
+        return 1;
+      args.insert(args.begin(), {dir.string(), "datasets"});
+    }
+  }
+  args.insert(args.begin(), "clean");
+  return runTool(cleanMain, args);
+}
+
+static int runAggregate(std::vector<std::string> args) {
+  std::error_code ec;
+  if (fs::is_directory("datasets/Climate"))
+    for (const auto& entry : fs::directory_iterator("datasets/Climate"))
+      if (entry.path().extension() == ".csv") fs::remove(entry.path(), ec);
+  args.insert(args.begin(), "climate");
+  const int status = runTool(climateMain, args);
+  fs::remove("datasets/Climate/Halmstad.csv", ec);
+  return status;
+}
+
+static int runNational(std::vector<std::string> args) {
+  args.insert(args.begin(), "sweden_average");
+  if (runTool(swedenAverageMain, args) != 0) return 1;
+  return runTool(trendsMain, {"trends"});
+}
+
+static int runBdays() {
+  // The stations clean kept in memory, else the B-days subset on disk
+  std::vector<std::string> cities = StationStore::instance().names();
+  const fs::path dir = "datasets/B-days";
+  if (cities.empty() && fs::is_directory(dir)) {
+    for (const auto& entry : fs::directory_iterator(dir)) {
+      const std::string city = entry.path().stem().string();
+      // Outputs of an earlier run are not station files
+      if (entry.path().extension() != ".csv" ||
+          (city.size() > 7 &&
+           city.compare(city.size() - 7, 7, "_points") == 0))
+        continue;
+      cities.push_back(city);
+    }
+    std::sort(cities.begin(), cities.end());
+  }
+
+  fs::remove_all("plots/bdays");
+  fs::create_directories("plots/bdays");
+  useMacroStyle();
+  int failed = 0;
+  for (const std::string& city : cities) {
+    std::cout << "Analyzing " << city << "..." << std::endl;
+    const std::string in = (dir / (city + ".csv")).string();
+    const std::string out = (dir / (city + "_points.csv")).string();
+    if (runTool(bdaysMain, {"b-days", in, out, "--dates", "11-06,03-11,04-12",
+                            "--hours", "10-15"}) != 0) {
+      ++failed;
+      continue;
+    }
+    plot_bdays(out.c_str(), city.c_str());
+    gROOT->GetListOfCanvases()->Delete();
+  }
+  return failed == 0 ? 0 : 1;
+}
+
+static int runSolar(unsigned threads) {
+  fs::create_directories("plots/solar");
+  useMacroStyle();
+  if (adjustTemps(threads) != 0) return 1;
+  const int status = plot_solar(threads);
+  gROOT->GetListOfCanvases()->Delete();
+  return status;
+}
+
+static int runPlot(unsigned threads) {
+  if (runTool(csvToRootMain, {"csv_to_root", "--mmap", "-j",
+                              std::to_string(threads), "datasets/B-days",
+                              "datasets/Climate", "datasets/Solar"}) != 0)
+    return 1;
+  // build/plot_climate runs without rootlogon.C, so with the default style
+  gROOT->SetStyle("Modern");
+  fs::remove_all("plots/mean_temps");
+  fs::remove_all("plots/max_min_temps");
+  return runTool(plotClimateMain,
+                 {"plot_climate", "-j", std::to_string(threads)});
+}
+
+static int usage(const char* name) {
+  std::cerr << "Usage: " << name
+            << " clean|aggregate|national|bdays|solar|plot|all|serve|ask"
+               " [options]"
             << std::endl;
-  return 0;
+  return 1;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) return usage(argv[0]);
+  const std::string command = argv[1];
+  std::vector<std::string> args(argv + 2, argv + argc);
+
+  // -j N and --no-store, for the commands that take no tool options
+  unsigned threads = defaultThreads();
+  bool store = true;
+  const bool tool_options = command == "clean" || command == "aggregate" ||
+                            command == "national" || command == "serve" ||
+                            command == "ask";
+  if (!tool_options) {
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      if (args[i] == "-j" && i + 1 < args.size()) {
+        threads = parseThreads(args[++i].c_str());
+      } else if (args[i] == "--no-store" && command == "all") {
+        store = false;
+      } else {
+        return usage(argv[0]);
+      }
+    }
+  }
+
+  gROOT->SetBatch(kTRUE);
+  StageReport report("pipeline-" + command);
+  int status = 0;
+  if (command == "serve" || command == "ask") {
+    // Long running or interactive, no stage report
+    args.insert(args.begin(), command);
+    return runTool(command == "serve" ? serveMain : askMain, args);
+  }
+  if (command == "clean") {
+    status = runClean(args);
+  } else if (command == "aggregate") {
+    status = runAggregate(args);
+  } else if (command == "national") {
+    status = runNational(args);
+  } else if (command == "bdays") {
+    status = runBdays();
+  } else if (command == "solar") {
+    status = runSolar(threads);
+  } else if (command == "plot") {
+    status = runPlot(threads);
+  } else if (command == "all") {
+    if (store) StationStore::instance().enable();
+    const std::string j = std::to_string(threads);
+    struct Step {
+      const char* name;
+      std::function<int()> run;
+    };
+    const std::vector<Step> steps = {
+        {"clean", [&] { return runClean({"-j", j}); }},
+        {"aggregate", [&] { return runAggregate({"-j", j}); }},
+        {"national",
+         [&] { return runNational({"-j", j, "--smooth", "10"}); }},
+        {"bdays", [&] { return runBdays(); }},
+        {"solar", [&] { return runSolar(threads); }},
+        {"plot", [&] { return runPlot(threads); }},
+    };
+    for (const Step& step : steps) {
+      ScopedPhase phase(report, step.name);
+      std::cout << "== " << step.name << std::endl;
+      status = step.run();
+      if (status != 0) {
+        std::cerr << "Stage " << step.name << " failed" << std::endl;
+        break;
+      }
+    }
+  } else {
+    return usage(argv[0]);
+  }
+  report.write();
+  return status;
 }
@@ -1,21 +1,73 @@
-rm -r build/
-mkdir build/
-g++ src/csv_to_root.cxx $(root-config --cflags --libs) -o ./build/csv_to_root
-g++ src/climate.cxx $(root-config --cflags --libs) -o ./build/climate
-g++ src/sweden_average.cxx $(root-config --cflags --libs) -o ./build/sweden_average
-
-g++ src/b-days.cxx $(root-config --cflags --libs) -o ./build/b-days
-./bash/clean.sh
-
-for city in datasets/clean/*.csv; do
-    echo "Processing $city"
-    echo "..."
-    ./build/climate $(basename "$city" .csv).csv
-done
-
-# Remove Halmstad
-rm ./datasets/Climate/Halmstad.csv
-./build/sweden_average
-./bash/csv_root.sh 
-
-rm ./datasets/Climate/*.csv
\ No newline at end of file
+#!/bin/bash
+# Compiles the .cxx tools, cleans and structures the data. Every step is a
+# stage (see bash/stage.sh) that is skipped when its inputs did not change.
+set -e
+source ./bash/stage.sh
+
+mkdir -p build/
+
+CXX_ROOT="$(root-config --cflags --libs)"
+
+run_stage build-clean "src/clean.cxx src/filter.cxx include" "build/clean" \
+    g++ -O2 -pthread -Iinclude src/clean.cxx src/filter.cxx -o ./build/clean
+run_stage build-csv_to_root "src/csv_to_root.cxx include" "build/csv_to_root" \
+    g++ -O2 -pthread -Iinclude src/csv_to_root.cxx $CXX_ROOT -o ./build/csv_to_root
+run_stage build-climate "src/climate.cxx src/filter.cxx include" "build/climate" \
+    g++ -O2 -pthread -Iinclude src/climate.cxx src/filter.cxx $CXX_ROOT -o ./build/climate
+run_stage build-sweden_average "src/sweden_average.cxx include" "build/sweden_average" \
+    g++ -O2 -pthread -Iinclude src/sweden_average.cxx $CXX_ROOT -o ./build/sweden_average
+run_stage build-b-days "src/b-days.cxx src/filter.cxx include" "build/b-days" \
+    g++ -O2 -Iinclude src/b-days.cxx src/filter.cxx $CXX_ROOT -o ./build/b-days
+run_stage build-trends "src/trends.cxx include" "build/trends" \
+    g++ -O2 -pthread -Iinclude src/trends.cxx -o ./build/trends
+run_stage build-stations "src/stations.cxx include" "build/stations" \
+    g++ -O2 -Iinclude src/stations.cxx -o ./build/stations
+run_stage build-query "src/query.cxx src/filter.cxx include" "build/query" \
+    g++ -O2 -Iinclude src/query.cxx src/filter.cxx -o ./build/query
+run_stage build-benchmark "src/benchmark.cxx src/filter.cxx include" "build/benchmark" \
+    g++ -O2 -Iinclude src/benchmark.cxx src/filter.cxx -o ./build/benchmark
+run_stage build-tests "src/tests.cxx include" "build/tests" \
+    g++ -O2 -Iinclude src/tests.cxx -o ./build/tests
+run_stage build-plot_climate "src/plot_climate.cxx src/plot_mean_temp_trend.C src/plot_max_min_trends.C include" \
+    "build/plot_climate" \
+    g++ -O2 -Iinclude -Isrc src/plot_climate.cxx $CXX_ROOT -o ./build/plot_climate
+# Every stage in one process, see main.cxx
+PIPELINE_SOURCES="src/clean.cxx src/climate.cxx src/sweden_average.cxx src/trends.cxx \
+    src/b-days.cxx src/csv_to_root.cxx src/solar.cxx src/plot_solar.cxx \
+    src/plot_climate.cxx src/serve.cxx src/filter.cxx"
+run_stage build-pipeline "main.cxx $PIPELINE_SOURCES src/plot_bdays.C src/plot_mean_temp_trend.C src/plot_max_min_trends.C include" \
+    "build/pipeline" \
+    g++ -O2 -pthread -DPIPELINE_DRIVER -Iinclude -Isrc main.cxx $PIPELINE_SOURCES $CXX_ROOT -o ./build/pipeline
+
+# Consistency checks of the shared numerics, see src/tests.cxx
+run_stage tests "$(stamp build-tests)" "" ./build/tests
+
+# RAW_ARCHIVE / RAW_DIR select other raw data, see bash/clean.sh
+run_stage clean "${RAW_DIR:-${RAW_ARCHIVE:-raw/datasets.tgz}} bash/clean.sh $(stamp build-clean)" \
+    "datasets/clean datasets/B-days datasets/Solar datasets/cache datasets/stations.csv" \
+    ./bash/clean.sh
+
+aggregate() {
+    rm -f datasets/Climate/*.csv
+    # One invocation streams every station file in datasets/clean
+    ./build/climate
+
+    # Remove Halmstad
+    rm -f ./datasets/Climate/Halmstad.csv
+}
+run_stage climate "$(stamp clean) $(stamp build-climate)" "datasets/Climate" \
+    aggregate
+
+# National average, with the decadal running means of it and of every
+# station in datasets/smoothed
+run_stage national "$(stamp climate) $(stamp build-sweden_average)" \
+    "datasets/Climate/Sweden.csv datasets/smoothed" \
+    ./build/sweden_average --smooth 10
+
+# Linear trends of every station and metric, the numbers of the trend plots
+run_stage trends "$(stamp national) $(stamp build-trends)" "datasets/trends.csv" \
+    ./build/trends
+
+run_stage csv_to_root "$(stamp national) $(stamp build-csv_to_root) bash/csv_root.sh" \
+    "datasets/Climate/Sweden.root" \
+    ./bash/csv_root.sh
@@ -1,5 +1,15 @@
-rm -r plots/
-mkdir plots/
+#!/bin/bash
+# Runs the whole pipeline. Stages whose inputs (data, sources, macros) did
+# not change since the last run are skipped, see bash/stage.sh. Use
+# FORCE=1 ./run_all.sh to redo everything.
+set -e
+source ./bash/stage.sh
+
+mkdir -p plots/
+
+# Timing reports of this run only, combined by bash/timeline.sh at the end
+mkdir -p "${MNXB_REPORT_DIR:-reports}"
+rm -f "${MNXB_REPORT_DIR:-reports}"/*.json
 
 # Compiles .cxx files , cleans and structures data
 chmod +x ./preprocess.sh
@@ -7,20 +17,35 @@ chmod +x ./preprocess.sh
 
 # Executes the solar analysis and generates plots for it
 chmod +x ./bash/solar_analysis.sh
-./bash/solar_analysis.sh
+run_stage solar "src/solar.cxx src/plot_solar.cxx include bash/solar_analysis.sh $(stamp clean)" \
+    "datasets/Solar/adjusted_temps.root plots/solar" \
+    ./bash/solar_analysis.sh
 
 # Executes the climate analysis and generates plots for it
 chmod +x ./bash/climate_analysis.sh
-./bash/climate_analysis.sh
+run_stage climate-plots "bash/climate_analysis.sh $(stamp csv_to_root) $(stamp build-plot_climate)" \
+    "plots/mean_temps plots/max_min_temps" \
+    ./bash/climate_analysis.sh
 
 
 # Executes the bday analysis and generates plots for it
 chmod +x ./bash/bdays.sh
-./bash/bdays.sh
-
-cd tex
-pdflatex main.tex
-pdflatex main.tex
-pdflatex main.tex
-rm -f *.aux *.log *.toc *.dvi *.fls *.fdb_latexmk *.out *.out.ps *.bbl *.blg
-mv main.pdf ../MNXB11-project.pdf
\ No newline at end of file
+run_stage bdays "src/plot_bdays.C bash/bdays.sh $(stamp clean) $(stamp build-b-days)" \
+    "plots/bdays" \
+    ./bash/bdays.sh
+
+report() {
+    cd tex
+    pdflatex main.tex
+    pdflatex main.tex
+    pdflatex main.tex
+    rm -f *.aux *.log *.toc *.dvi *.fls *.fdb_latexmk *.out *.out.ps *.bbl *.blg
+    mv main.pdf ../MNXB11-project.pdf
+    cd ..
+}
+run_stage report "tex $(stamp solar) $(stamp climate-plots) $(stamp bdays)" \
+    "MNXB11-project.pdf" \
+    report
+
+# Where the time of this run went, stage by stage
+./bash/timeline.sh
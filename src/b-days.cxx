@@ -1,135 +1,133 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>    
 #include <string>
-#include <map>      
-#include <vector> 
-#include <tuple>
-#include <algorithm>
-#include <cctype>
-#include <locale>
-
-
-void filter_time(const char* inputFile = "datasets/B-days/Lund.csv",
-                         const char* outputFile = "datasets/B-days/temp.csv",
-                         int startHour = 10,
-                         int stopHour = 15){
-    std::ifstream in(inputFile);
-    std::ofstream out(outputFile);
-
-    std::string line;
-    int total=0, kept=0;
-
-    while (std::getline(in, line)) //true if can read line
-    {
-        total++;
-        std::stringstream ss(line); //want to read pieces of the line
-        std::string col; //store column
-
-        for (int i = 0; i < 3; ++i) std::getline(ss, col, ';');
-        if (!std::getline(ss, col, ';')) continue;
-        int hour = std::stoi(col);
-        if (hour >= startHour && hour <= stopHour) {
-            out << line << "\n";
-            kept++;
-        }
-    }
-    std::cout<< " lines, kept " << kept << " lines.\n";
+#include <vector>
+#include <filesystem>
+
+#include "b-days.h"
+#include "filter.h"
+#include "instrument.h"
+#include "parse_utils.h"
+#include "station_cache.h"
+#include "station_store.h"
+
+// Usage:
+// ./build/b-days input.csv output.csv [--dates MM-DD,...] [--hours START-STOP]
+//                [--where FILTER]
+//
+// Reads a station file (year;month;day;hour;temperature;lat;lon) once and
+// writes, for every selected date and year, the average temperature between
+// the start and stop hour (inclusive) as "year;month;day;avg", grouped by
+// date. Defaults: our birthdays 11-06, 03-11 and 04-12 between 10 and 15 UTC.
+// --where adds further filter clauses, e.g. "year=1950-2024" (see filter.h).
+// If build/clean wrote a columnar cache for the station it is read instead,
+// and in build/pipeline the station's columns already in memory.
+
+struct BdayOptions {
+    std::string dates = "11-06,03-11,04-12";
+    std::string hours = "10-15";
+    std::string where;
+
+    std::string expression() const {
+        return "date=" + dates + " hour=" + hours + " " + where;
     }
-    
-void yearly_avg(const char* inputFile = "datasets/B-days/temp.csv", 
-                const char* outputFile = "datasets/B-days/temp.csv"){
+};
+
+static bool readText(const char* inputFile, BirthdayAverages &averages) {
     std::ifstream in(inputFile);
+    if (!in.is_open()) return false;
 
-    std::map<std::tuple<int,int,int>, std::pair<double,int>> data;
     std::string line;
-    int total =0;
-
-
-    while (std::getline(in, line))
-    {
-        total++;
-        std::stringstream ss(line);
+    std::string_view f[5];
+    while (std::getline(in, line)) {
         int year, month, day, hour;
         double temp;
-        char sep;
-
-        ss >> year >> sep >> month >> sep >> day >> sep >> hour >> sep >> temp;
-
-        auto key= std::make_tuple(year, month, day);
-        data[key].first += temp;
-        data[key].second++;
-    }
-
-    std::ofstream out(outputFile);
-    
-    int written =0;
-
-    for (const auto& [key, val] : data) {
-        auto [year, month, day] = key;
-        double avg = val.first / val.second;
-        out << year << ";" << month << ";" << day << ";" << avg << "\n";
-        written++;
+        if (splitFields(line, ';', f, 5) < 5 || !parseInt(f[0], year) ||
+            !parseInt(f[1], month) || !parseInt(f[2], day) ||
+            !parseInt(f[3], hour) || !parseDouble(f[4], temp))
+            continue;
+        averages.add(year, month, day, hour, temp);
     }
-    std::cout << "Averages written to " << outputFile
-              << " (" << data.size() << " entries)\n";
-    std::cout << "Lines read: " << total << ", lines written: " << written 
-              << " (" << data.size() << " unique days)\n";
-
+    return true;
 }
 
-void points(const char* inputFile="datasets/B-days/temp.csv",
-            const char* outputFile="datasets/B-days/Lund_points.csv"){
-    std::string line;
-    std::ifstream in(inputFile);
-
-    // separate data for each day -> vectors of year,temp
-    std::map<std::pair<int,int>, std::vector<std::pair<int,double>>> data;
-    int year, month, day;
-    double avg;
-
-    while (std::getline(in, line)) {
-        if (line.empty()) continue;
-        std::stringstream ss(line);
-        std::string token;
-        std::vector<std::string> tokens;
-
-         while (std::getline(ss, token, ';')) {
-            tokens.push_back(token);
+static bool parseOptions(int argc, char* argv[], BdayOptions &opt,
+                         std::vector<std::string> &files) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dates" && i + 1 < argc) {
+            opt.dates = argv[++i];
+        } else if (arg == "--hours" && i + 1 < argc) {
+            opt.hours = argv[++i];
+        } else if (arg == "--where" && i + 1 < argc) {
+            opt.where = argv[++i];
+        } else {
+            files.push_back(arg);
         }
-        
-        
-        year = std::stoi(tokens[0]);
-        month = std::stoi(tokens[1]);
-        day = std::stoi(tokens[2]);
-        avg = std::stod(tokens[3]);
-
-    if ((month==11 && day==6) || (month==3 && day==11) || (month==4 && day==12)) {
-        data[{month, day}].push_back({year, avg});
     }
+    return files.size() == 2;
 }
-    
-    std::ofstream out(outputFile);
-    
 
-    for (const auto& [key, vec] : data) {
-        auto [month, day] = key;
-        for (const auto& [year, avg] : vec) {
-            out << year << ";" << month << ";" << day << ";" << avg << "\n";
-        }
+int bdaysMain(int argc, char* argv[]) {
+    BdayOptions opt;
+    std::vector<std::string> files;
+    if (!parseOptions(argc, argv, opt, files)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " input.csv output.csv [--dates MM-DD,...] [--hours START-STOP]"
+                  << " [--where FILTER]" << std::endl;
+        return 1;
     }
 
-    std::cout << "Filtered data written to " << outputFile 
-              << " (" << data.size() << " day groups)\n";
-}
-
+    // The columns hold every observation, the text files only quality G ones
+    std::string city = std::filesystem::path(files[0]).stem().string();
+    const auto stored = StationStore::instance().find(city);
+    StationCache cache;
+    if (!stored) cache = StationCache(stationCachePath("datasets/cache", city));
+    const bool columns = stored || cache.is_open();
+    std::string expression = opt.expression() + (columns ? " quality=G" : "");
+
+    Filter filter;
+    std::string error;
+    if (!filter.compile(expression, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    if (!filter.matchesStation(city)) {
+        std::cerr << city << " is excluded by the filter" << std::endl;
+        return 0;
+    }
+    BirthdayAverages averages(filter);
+    StageReport report("b-days-" + city);
 
+    // Use the columnar cache of this station when build/clean wrote one
+    {
+        ScopedPhase phase(report, "read");
+        std::error_code ec;
+        if (stored) {
+            averages.add(stored->view());
+        } else if (cache.is_open()) {
+            averages.add(cache.view());
+            phase.addBytes(std::filesystem::file_size(
+                stationCachePath("datasets/cache", city), ec));
+        } else if (readText(files[0].c_str(), averages)) {
+            phase.addBytes(std::filesystem::file_size(files[0], ec));
+        } else {
+            std::cerr << "Error: cannot open " << files[0] << std::endl;
+            return 1;
+        }
+        phase.addRows(averages.rows);
+    }
 
-int main(int argc, char* argv[]) {
-    filter_time(argv[1], "datasets/B-days/temp.csv");
-    yearly_avg("datasets/B-days/temp.csv", "datasets/B-days/temp.csv");
-    points("datasets/B-days/temp.csv", argv[2]);
+    ScopedPhase writePhase(report, "write");
+    std::size_t written = averages.write(files[1].c_str());
+    writePhase.stop();
+    report.write();
+    std::cout << "Filter: " << expression << "\n";
+    std::cout << "Lines read: " << averages.rows << ", kept " << averages.kept
+              << ", " << written << " date averages written to " << files[1] << "\n";
+    return 0;
 }
 
-
-
+#ifndef PIPELINE_DRIVER
+int main(int argc, char* argv[]) { return bdaysMain(argc, argv); }
+#endif
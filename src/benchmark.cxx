@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "b-days.h"
+#include "benchmark.h"
+#include "climate.h"
+#include "csv_to_root.h"
+#include "filter.h"
+#include "parse_utils.h"
+#include "solar.h"
+#include "station_cache.h"
+
+// Usage:
+// g++ -O2 -Iinclude src/benchmark.cxx src/filter.cxx -o build/benchmark
+// ./build/benchmark [--rows N] [--reps R] [--filter NAME] [--csv FILE]
+//                   [--baseline FILE]
+//
+// Times the hot paths of the pipeline on a fixed synthetic station (hourly
+// rows from 1900 on, fixed seed), with the code the tools themselves use:
+//
+//   tokenize/*  the ';' splitting of csv_to_root (stringstream and --mmap
+//               parsers) and of the Solar/ rows in solar.cxx
+//   climate/*   the streaming yearly and monthly summaries of climate.cxx
+//   bdays/*     the map based averaging of b-days, row at a time and over
+//               the cached columns
+//   select/*    Filter::select of summers since 1990, over every row and
+//               with the zone maps of the cache skipping blocks
+//   solar/*     dayOfYear, toaHorizontalIrradiance_Wm2,
+//               meanToaIrradiance_Wm2_sameHour and their memoized and batch
+//               replacements
+//
+// Prints ns/row (median and min over R repetitions, after one warm-up run),
+// the relative spread and rows/s. --csv writes the results; a later run with
+// --baseline on that file adds the speedup of every case over it. --filter
+// only runs the cases whose name contains NAME. Timings only; whether the
+// faster replacements still agree with the code they replace is checked by
+// build/tests (src/tests.cxx).
+
+// The synthetic station: consecutive hours from 1900-01-01 00 UTC with a
+// seasonal and daily temperature cycle plus noise
+struct SyntheticStation {
+  StationColumns columns;
+  std::vector<std::string> lines;  // year;month;day;hour;temp;lat;lon
+  std::string text;                // the lines joined by '\n'
+
+  explicit SyntheticStation(std::size_t rows) {
+    columns.name = "Bench";
+    columns.latitude = 55.7058;
+    columns.longitude = 13.1932;
+    std::mt19937 rng(12345);
+    std::normal_distribution<double> noise(0.0, 2.5);
+    const int days_in_month[] = {0, 31, 28, 31, 30, 31, 30,
+                                 31, 31, 30, 31, 30, 31};
+    int year = 1900, month = 1, day = 1, hour = 0;
+    char buffer[96];
+    lines.reserve(rows);
+    for (std::size_t i = 0; i < rows; ++i) {
+      const int J = dayOfYear(year, month, day);
+      const double t = 8.0 - 9.0 * std::cos(2 * PI * (J - 15) / 365.25) -
+                       3.0 * std::cos(2 * PI * (hour - 3) / 24.0) +
+                       noise(rng);
+      const float temp = std::round(t * 10) / 10.0f;
+      columns.add(year, month, day, hour, temp, i % 50 ? 'G' : 'Y');
+      std::snprintf(buffer, sizeof buffer, "%d;%02d;%02d;%02d;%.1f;%.4f;%.4f",
+                    year, month, day, hour, temp, columns.latitude,
+                    columns.longitude);
+      lines.emplace_back(buffer);
+
+      if (++hour < 24) continue;
+      hour = 0;
+      const int month_days = days_in_month[month] + (month == 2 && isLeap(year));
+      if (++day <= month_days) continue;
+      day = 1;
+      if (++month <= 12) continue;
+      month = 1;
+      ++year;
+    }
+    for (const std::string& line : lines) text += line + '\n';
+  }
+};
+
+int main(int argc, char* argv[]) {
+  std::size_t rows = 1000000;
+  int repetitions = 15;
+  std::string filter, csv, baseline;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--rows" && i + 1 < argc) {
+      rows = std::max<std::size_t>(1000, std::stoul(argv[++i]));
+    } else if (arg == "--reps" && i + 1 < argc) {
+      repetitions = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "--filter" && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (arg == "--csv" && i + 1 < argc) {
+      csv = argv[++i];
+    } else if (arg == "--baseline" && i + 1 < argc) {
+      baseline = argv[++i];
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--rows N] [--reps R] [--filter NAME] [--csv FILE]"
+                   " [--baseline FILE]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  const SyntheticStation station(rows);
+  const StationView v = station.columns.view();
+  std::cout << rows << " rows (" << station.text.size() / 1e6
+            << " MB of text), " << repetitions << " repetitions\n\n";
+
+  BenchmarkSuite suite(repetitions, filter, baseline);
+  suite.printHeader();
+
+  // ---------- ';' tokenizing ----------
+  suite.run("tokenize/stringstream", rows, [&] {
+    Row row;
+    double sum = 0;
+    for (const std::string& line : station.lines)
+      if (tokenizeRow(line, row)) sum += row.temperature;
+    doNotOptimize(sum);
+  });
+  suite.run("tokenize/parseRow", rows, [&] {
+    Row row;
+    double sum = 0;
+    forEachLine(station.text, [&](std::string_view line) {
+      if (parseRow(line, row)) sum += row.temperature;
+    });
+    doNotOptimize(sum);
+  });
+  suite.run("tokenize/parseSolarLine", rows, [&] {
+    int year, month, day, hour;
+    double temp, lat, lon, sum = 0;
+    for (const std::string& line : station.lines)
+      if (parseSolarLine(line, year, month, day, hour, temp, lat, lon))
+        sum += temp;
+    doNotOptimize(sum);
+  });
+
+  // ---------- climate.cxx summaries, output discarded ----------
+  for (int depth : {1, 2}) {
+    suite.run(depth == 1 ? "climate/yearly" : "climate/monthly", rows, [&] {
+      PeriodSummary summary("/dev/null", depth);
+      for (std::size_t i = 0; i < v.rows; ++i)
+        if (v.good(i))
+          summary.add(v.year[i], v.month[i], v.day[i], v.temperature[i]);
+      summary.finish();
+      doNotOptimize(summary.periods());
+    });
+  }
+
+  // ---------- b-days averaging ----------
+  Filter bdays;
+  std::string error;
+  if (!bdays.compile("date=11-06,03-11,04-12 hour=10-15", error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  suite.run("bdays/rows", rows, [&] {
+    BirthdayAverages averages(bdays);
+    for (std::size_t i = 0; i < v.rows; ++i)
+      averages.add(v.year[i], v.month[i], v.day[i], v.hour[i],
+                   v.temperature[i]);
+    doNotOptimize(averages.kept);
+  });
+  suite.run("bdays/columns", rows, [&] {
+    BirthdayAverages averages(bdays);
+    averages.add(v);
+    doNotOptimize(averages.kept);
+  });
+
+  // ---------- Zone map skipping ----------
+  Filter summers;
+  if (!summers.compile("year=1990-2024 month=6-8", error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  const std::vector<ZoneMap> zones = computeZoneMaps(v);
+  const StationView zoned = [&] {
+    StationView z = v;
+    z.zones = zones.data();
+    return z;
+  }();
+  std::vector<std::uint32_t> selection;
+  for (const StationView* view : {&v, &zoned}) {
+    suite.run(view->zones ? "select/zones" : "select/scan", rows, [&] {
+      selection.clear();
+      summers.select(*view, selection);
+      doNotOptimize(selection.size());
+    });
+  }
+
+  // ---------- Solar geometry ----------
+  suite.run("solar/dayOfYear", rows, [&] {
+    long sum = 0;
+    for (std::size_t i = 0; i < v.rows; ++i)
+      sum += dayOfYear(v.year[i], v.month[i], v.day[i]);
+    doNotOptimize(sum);
+  });
+  suite.run("solar/toaHorizontalIrradiance", rows, [&] {
+    double sum = 0;
+    for (std::size_t i = 0; i < v.rows; ++i)
+      sum += toaHorizontalIrradiance_Wm2(v.year[i], v.month[i], v.day[i],
+                                         v.hour[i], v.longitude, v.latitude);
+    doNotOptimize(sum);
+  });
+  // A full year of evaluations per call, so on a share of the rows
+  const std::size_t mean_rows = std::max<std::size_t>(rows / 100, 1);
+  suite.run("solar/meanToaIrradiance_sameHour", mean_rows, [&] {
+    double sum = 0;
+    for (std::size_t i = 0; i < mean_rows; ++i)
+      sum += meanToaIrradiance_Wm2_sameHour(v.year[i], v.hour[i], v.longitude,
+                                            v.latitude);
+    doNotOptimize(sum);
+  });
+  // What solar.cxx does per row instead: both values from one table per
+  // station, the table built inside the timed loop
+  suite.run("solar/IrradianceTable", rows, [&] {
+    const IrradianceTable table(v.longitude, v.latitude);
+    double sum = 0;
+    for (std::size_t i = 0; i < v.rows; ++i)
+      sum += table.irradiance(v.year[i], v.month[i], v.day[i], v.hour[i]) -
+             table.mean(v.year[i], v.hour[i]);
+    doNotOptimize(sum);
+  });
+
+  // Scalar and batch kernels on random days, hours and Swedish positions
+  std::mt19937 rng(12345);
+  std::uniform_int_distribution<int> day(1, 366), hour(0, 23);
+  std::uniform_real_distribution<double> lat(55.3, 69.1), lon(11.0, 24.2);
+  std::vector<int> doy(rows), hours(rows);
+  std::vector<double> lons(rows), lats(rows), scalar(rows), batch(rows);
+  for (std::size_t i = 0; i < rows; ++i) {
+    doy[i] = day(rng);
+    hours[i] = hour(rng);
+    lons[i] = lon(rng);
+    lats[i] = lat(rng);
+  }
+  suite.run("solar/toaIrradianceOnDay", rows, [&] {
+    for (std::size_t i = 0; i < rows; ++i)
+      scalar[i] = toaIrradianceOnDay_Wm2(doy[i], hours[i], lons[i], lats[i]);
+    doNotOptimize(scalar.back());
+  });
+  suite.run("solar/batch", rows, [&] {
+    toaHorizontalIrradianceBatch(doy.data(), hours.data(), lons.data(),
+                                 lats.data(), batch.data(), rows);
+    doNotOptimize(batch.back());
+  });
+
+  if (!csv.empty() && !suite.writeCsv(csv)) {
+    std::cerr << "Could not write " << csv << "\n";
+    return 1;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "filter.h"
+#include "parallel.h"
+#include "parse_utils.h"
+#include "station_cache.h"
+#include "station_store.h"
+#include "stations.h"
+
+// Usage:
+// g++ -O2 -pthread -Iinclude src/clean.cxx src/filter.cxx -o build/clean
+// ./build/clean [raw_dir] [datasets_dir] [-j N] [--subset NAME=FILTER ...]
+//               [--no-cache]
+//
+// Reads every raw SMHI station file in raw_dir (default datasets/raw) once and
+// writes, for each station,
+//   datasets/clean/City.csv   year;month;day;hour;temperature;lat;lon
+//   datasets/NAME/City.csv    the rows of clean/ that pass FILTER, for each
+//                             --subset (filter syntax in filter.h)
+//   datasets/cache/City.col   all observations as a binary columnar cache,
+//                             see station_cache.h
+// and datasets/stations.csv, the registry of the stations with their
+// position and years (see stations.h).
+// Without --subset the B-days (date=11-06,04-12,03-11) and Solar (hour=11-15)
+// subsets are cut. Station files are handled in parallel, one file per
+// worker thread. Run as the clean stage of build/pipeline (main.cxx), the
+// observations also stay in memory for the later stages (station_store.h).
+
+namespace fs = std::filesystem;
+
+// A subset of clean/ written to datasets/<name>/
+struct Subset {
+  std::string name;
+  Filter filter;
+};
+
+struct CleanOptions {
+  fs::path raw_dir = "datasets/raw";
+  fs::path out_dir = "datasets";
+  unsigned threads = defaultThreads();
+  std::vector<Subset> subsets;
+  bool write_cache = true;
+};
+
+struct CleanResult {
+  std::string city;
+  long raw_lines = 0;
+  long clean_rows = 0;
+  std::vector<long> subset_rows;  // -1 if the station is not in the subset
+  StationInfo info;               // for the station registry
+  bool ok = false;
+};
+
+// Checks `s` against a fixed-width pattern where 'd' is a digit, ' ' is any
+// whitespace and every other character must match literally.
+static bool matchesPattern(std::string_view s, std::string_view pattern) {
+  if (s.size() != pattern.size()) return false;
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    if (pattern[i] == 'd') {
+      if (!std::isdigit(c)) return false;
+    } else if (pattern[i] == ' ') {
+      if (!std::isspace(c)) return false;
+    } else if (s[i] != pattern[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// -?[0-9]+([.][0-9]+)?
+static bool isDecimal(std::string_view s) {
+  if (!s.empty() && s.front() == '-') s.remove_prefix(1);
+  std::size_t i = 0;
+  while (i < s.size() && std::isdigit(static_cast<unsigned char>(s[i]))) ++i;
+  if (i == 0) return false;
+  if (i == s.size()) return true;
+  if (s[i] != '.') return false;
+  std::size_t frac = ++i;
+  while (i < s.size() && std::isdigit(static_cast<unsigned char>(s[i]))) ++i;
+  return i > frac && i == s.size();
+}
+
+static bool readWholeFile(const fs::path& path, std::string& text) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  in.seekg(0, std::ios::end);
+  text.resize(static_cast<std::size_t>(in.tellg()));
+  in.seekg(0, std::ios::beg);
+  in.read(text.data(), static_cast<std::streamsize>(text.size()));
+  return static_cast<bool>(in) || in.eof();
+}
+
+static bool writeWholeFile(const fs::path& path, const std::string& text) {
+  std::ofstream out(path, std::ios::binary);
+  if (!out) return false;
+  out.write(text.data(), static_cast<std::streamsize>(text.size()));
+  return static_cast<bool>(out);
+}
+
+// One pass over a raw station file. The metadata line
+// "YYYY-MM-DD HH:MM:SS;YYYY-MM-DD HH:MM:SS;H;LAT;LON" sets the station
+// position for the rows that follow it, data rows "YYYY-MM-DD;HH:MM:SS;T;Q"
+// are kept if the quality code is G.
+static CleanResult cleanStation(const fs::path& raw, const std::string& city,
+                                const CleanOptions& opt) {
+  CleanResult result;
+  result.city = city;
+
+  std::string text;
+  if (!readWholeFile(raw, text)) {
+    std::cerr << "Could not open " << raw << "\n";
+    return result;
+  }
+
+  std::string clean;
+  clean.reserve(text.size() / 2);
+  // Columns of the rows in clean/ and where each row starts in `clean`, so
+  // the subset filters can run over columns and copy the selected rows
+  StationColumns kept;
+  std::vector<std::size_t> row_start;
+
+  StationColumns cache;
+  cache.name = city;
+  const bool keep_columns =
+      opt.write_cache || StationStore::instance().enabled();
+
+  std::string_view lat, lon;
+  std::string_view f[5];
+
+  forEachLine(text, [&](std::string_view line) {
+    ++result.raw_lines;
+    int n = splitFields(line, ';', f, 5);
+
+    if (n >= 5 && matchesPattern(f[0], "dddd-dd-dd dd:dd:dd") &&
+        matchesPattern(f[1], "dddd-dd-dd dd:dd:dd") && isDecimal(f[3]) &&
+        isDecimal(f[4])) {
+      lat = f[3];
+      lon = f[4];
+      return;
+    }
+
+    if (n < 4 || !matchesPattern(f[0], "dddd-dd-dd") ||
+        !matchesPattern(f[1], "dd:dd:dd"))
+      return;
+    std::string_view code = trim(f[3], " \t\"");
+
+    int y, mo, d, h;
+    parseInt(f[0].substr(0, 4), y);
+    parseInt(f[0].substr(5, 2), mo);
+    parseInt(f[0].substr(8, 2), d);
+    parseInt(f[1].substr(0, 2), h);
+
+    // The cache keeps every observation with a temperature, whatever its code
+    double value = 0;
+    bool has_value = parseDouble(f[2], value);
+    if (keep_columns && has_value)
+      cache.add(y, mo, d, h, static_cast<float>(value),
+                code.empty() ? '?' : code[0]);
+
+    // A G row without a readable temperature is dropped from clean/ and the
+    // subsets as well, so that the text and the columns hold the same rows
+    if (code != "G" || !has_value) return;
+
+    std::string_view year = f[0].substr(0, 4);
+    std::string_view month = f[0].substr(5, 2);
+    std::string_view day = f[0].substr(8, 2);
+    // Hour without leading zeros, "00" becomes "0"
+    std::string_view hour = f[1].substr(0, 2);
+    if (hour[0] == '0') hour.remove_prefix(1);
+
+    row_start.push_back(clean.size());
+    clean.append(year).append(";").append(month).append(";").append(day);
+    clean.append(";").append(hour).append(";").append(f[2]);
+    clean.append(";").append(lat).append(";").append(lon).append("\n");
+    kept.add(y, mo, d, h, static_cast<float>(value), 'G');
+    ++result.clean_rows;
+  });
+  row_start.push_back(clean.size());
+
+  result.info.name = city;
+  result.info.rows = result.clean_rows;
+  parseDouble(lat, result.info.latitude);
+  parseDouble(lon, result.info.longitude);
+  if (kept.size() > 0) {
+    const auto [first, last] =
+        std::minmax_element(kept.year.begin(), kept.year.end());
+    result.info.first_year = *first;
+    result.info.last_year = *last;
+  }
+
+  const std::string file = city + ".csv";
+  result.ok = writeWholeFile(opt.out_dir / "clean" / file, clean);
+
+  // Every subset is a filter over the columns of clean/, evaluated in batches
+  const StationView rows = kept.view();
+  std::vector<std::uint32_t> selection;
+  std::string subset;
+  for (const auto& sub : opt.subsets) {
+    if (!sub.filter.matchesStation(city)) {
+      result.subset_rows.push_back(-1);
+      continue;
+    }
+    selection.clear();
+    sub.filter.select(rows, selection);
+    subset.clear();
+    for (std::uint32_t i : selection)
+      subset.append(clean, row_start[i], row_start[i + 1] - row_start[i]);
+    result.subset_rows.push_back(static_cast<long>(selection.size()));
+    result.ok = writeWholeFile(opt.out_dir / sub.name / file, subset) &&
+                result.ok;
+  }
+
+  // The latest station position, as for the last rows of clean/
+  parseDouble(lat, cache.latitude);
+  parseDouble(lon, cache.longitude);
+  if (result.ok && opt.write_cache)
+    result.ok = writeStationCache(
+        stationCachePath((opt.out_dir / "cache").string(), city), cache);
+  if (result.ok) StationStore::instance().put(std::move(cache));
+  if (!result.ok) std::cerr << "Could not write outputs for " << city << "\n";
+  return result;
+}
+
+// "smhi-opendata_1_53430_20241020_Lund.csv" -> "Lund", the same naming as
+// ${f##*_} in the old clean.sh.
+static std::string cityName(const fs::path& raw) {
+  std::string stem = raw.stem().string();
+  return stem.substr(stem.find_last_of('_') + 1);
+}
+
+static bool parseOptions(int argc, char* argv[], CleanOptions& opt) {
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      opt.threads = parseThreads(argv[++i]);
+    } else if (arg == "--subset" && i + 1 < argc) {
+      std::string spec = argv[++i];
+      std::size_t eq = spec.find('=');
+      Subset sub;
+      std::string error;
+      if (eq == std::string::npos || eq == 0) {
+        std::cerr << "Bad subset " << spec << ", expected NAME=FILTER\n";
+        return false;
+      }
+      sub.name = spec.substr(0, eq);
+      if (!sub.filter.compile(spec.substr(eq + 1), error)) {
+        std::cerr << "Bad filter for subset " << sub.name << ": " << error
+                  << "\n";
+        return false;
+      }
+      opt.subsets.push_back(std::move(sub));
+    } else if (arg == "--no-cache") {
+      opt.write_cache = false;
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::cerr << "Unknown option " << arg << "\n";
+      return false;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() > 0) opt.raw_dir = positional[0];
+  if (positional.size() > 1) opt.out_dir = positional[1];
+
+  if (opt.subsets.empty()) {
+    std::string error;
+    opt.subsets.resize(2);
+    opt.subsets[0].name = "B-days";
+    opt.subsets[0].filter.compile("date=11-06,04-12,03-11", error);
+    opt.subsets[1].name = "Solar";
+    opt.subsets[1].filter.compile("hour=11-15", error);
+  }
+  return true;
+}
+
+int cleanMain(int argc, char* argv[]) {
+  CleanOptions opt;
+  if (!parseOptions(argc, argv, opt)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [raw_dir] [datasets_dir] [-j N] [--subset NAME=FILTER ...]"
+                 " [--no-cache]"
+              << std::endl;
+    return 1;
+  }
+
+  if (!fs::is_directory(opt.raw_dir)) {
+    std::cerr << "Input directory not found: " << opt.raw_dir << "\n";
+    return 1;
+  }
+  fs::create_directories(opt.out_dir / "clean");
+  fs::create_directories(opt.out_dir / "cache");
+  for (const auto& sub : opt.subsets)
+    fs::create_directories(opt.out_dir / sub.name);
+
+  // Sorted so that, as with the old cp loop, the last file wins when two raw
+  // files map to the same city.
+  std::vector<fs::path> raws;
+  for (const auto& entry : fs::directory_iterator(opt.raw_dir)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".csv")
+      raws.push_back(entry.path());
+  }
+  std::sort(raws.begin(), raws.end());
+
+  std::map<std::string, fs::path> by_city;
+  for (const auto& p : raws) {
+    auto [it, inserted] = by_city.insert_or_assign(cityName(p), p);
+    if (!inserted)
+      std::cerr << "Warning: " << it->first << " has more than one raw file, "
+                << "using " << p.filename() << "\n";
+  }
+  std::vector<std::pair<std::string, fs::path>> jobs(by_city.begin(),
+                                                     by_city.end());
+
+  std::vector<CleanResult> results(jobs.size());
+  parallelFor(jobs.size(), opt.threads, [&](std::size_t i) {
+    results[i] = cleanStation(jobs[i].second, jobs[i].first, opt);
+  });
+
+  std::size_t failed = 0;  // stations
+  std::vector<StationInfo> registry;
+  for (const auto& r : results) {
+    if (!r.ok) {
+      ++failed;
+      continue;
+    }
+    registry.push_back(r.info);
+    std::cout << r.city << ": " << r.raw_lines << " → " << r.clean_rows
+              << " lines";
+    bool first = true;  // subsets printed so far
+    for (std::size_t s = 0; s < opt.subsets.size(); ++s) {
+      if (r.subset_rows[s] < 0) continue;
+      std::cout << (first ? " (" : ", ") << opt.subsets[s].name << " "
+                << r.subset_rows[s];
+      first = false;
+    }
+    std::cout << (first ? "\n" : ")\n");
+  }
+  const fs::path registry_path = opt.out_dir / "stations.csv";
+  const bool registry_ok =
+      writeStationRegistry(registry_path.string(), registry);
+  if (!registry_ok)
+    std::cerr << "Could not write " << registry_path << "\n";
+  std::cout << "Cleaned " << results.size() - failed << " station files with "
+            << std::min<std::size_t>(opt.threads, std::max<std::size_t>(
+                                                      1, jobs.size()))
+            << " threads\n";
+  return failed == 0 && registry_ok ? 0 : 1;
+}
+
+#ifndef PIPELINE_DRIVER
+int main(int argc, char* argv[]) { return cleanMain(argc, argv); }
+#endif
@@ -1,75 +1,215 @@
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
-int main(int argc, char* argv[]) {
-  if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " input.csv [output.root]"
-              << std::endl;
-    return 1;
-  }
-  std::string city = argv[1];
-  std::ifstream input("datasets/clean/" + city);
-  if (!input.is_open()) {
-    std::cerr << "Could not open " << city << ".csv\n";
-    return 1;
-  }
+#include "climate.h"
+#include "filter.h"
+#include "instrument.h"
+#include "parallel.h"
+#include "parse_utils.h"
+#include "station_cache.h"
+#include "station_store.h"
+#include "stations.h"
+
+// Usage:
+// ./build/climate [City.csv ...] [--monthly] [--daily] [-j N] [--where EXPR]
+//                 [--near LAT,LON [-k N] | --box LAT0,LAT1,LON0,LON1 |
+//                  --band LAT0,LAT1]
+//
+// Summarizes the cleaned station files in datasets/clean (all of them if no
+// city is given) into datasets/Climate/City.csv with one
+// "year; max; min; mean" line per year. --monthly and --daily also write
+// datasets/Climate/monthly/City.csv ("year; month; max; min; mean") and
+// datasets/Climate/daily/City.csv ("year; month; day; max; min; mean") from
+// the same pass.
+//
+// Rows are streamed, only one running accumulator per period is kept, so
+// memory does not grow with the size of the file. The rows are expected in
+// time order, as build/clean writes them. If build/clean wrote a columnar
+// cache for the station (datasets/cache/City.col) it is read instead of the
+// text file. --near, --box and --band summarize the stations of the
+// registry datasets/stations.csv in that region (see stations.h). --where
+// only summarizes the rows passing a filter expression (see filter.h), e.g.
+// --where "year=1990-2024 month=6-8"; with the cache, blocks of rows outside
+// the years, months or hours of the expression are not read at all.
 
-  std::vector<std::vector<std::string>> data;
-  std::string line;
+namespace fs = std::filesystem;
 
-  while (std::getline(input, line)) {
-    std::vector<std::string> row;
-    std::stringstream ss(line);
-    std::string cell;
+struct ClimateOptions {
+  bool monthly = false;
+  bool daily = false;
+  unsigned threads = defaultThreads();
+  fs::path clean_dir = "datasets/clean";
+  fs::path cache_dir = "datasets/cache";
+  fs::path out_dir = "datasets/Climate";
+  Filter where;
+};
 
-    while (std::getline(ss, cell, ';')) {
-      row.push_back(cell);
+// Streams one station through every requested summary. Returns the number
+// of rows used, or -1 if the station could not be read or written. The size
+// of the file read is added to `bytes`.
+static long summarizeStation(const std::string& city,
+                             const ClimateOptions& opt, std::uintmax_t& bytes) {
+  std::vector<PeriodSummary> summaries;
+  summaries.reserve(3);
+  summaries.emplace_back(opt.out_dir / (city + ".csv"), 1);
+  if (opt.monthly)
+    summaries.emplace_back(opt.out_dir / "monthly" / (city + ".csv"), 2);
+  if (opt.daily)
+    summaries.emplace_back(opt.out_dir / "daily" / (city + ".csv"), 3);
+  for (const auto& s : summaries) {
+    if (!s.is_open()) {
+      std::cerr << "Could not open output for " << city << "\n";
+      return -1;
     }
-    data.push_back(row);
   }
 
-  input.close();
+  long rows = 0;
+  auto add = [&](int y, int m, int d, double t) {
+    for (auto& s : summaries) s.add(y, m, d, t);
+    ++rows;
+  };
 
-  std::ofstream output("datasets/Climate/" + city);
-  if (!output.is_open()) {
-    std::cerr << "Could not open " << city << ".csv\n";
-    return 1;
+  // In build/pipeline the station is still in memory from the clean stage.
+  // Otherwise prefer the columnar cache written by build/clean, it needs no
+  // parsing.
+  const auto stored = StationStore::instance().find(city);
+  const std::string cache_path =
+      stationCachePath(opt.cache_dir.string(), city);
+  StationCache cache;
+  if (!stored) cache = StationCache(cache_path);
+  std::error_code ec;
+  if (stored || cache.is_open()) {
+    if (!stored) bytes += fs::file_size(cache_path, ec);
+    const StationView v = stored ? stored->view() : cache.view();
+    if (opt.where.expression().empty()) {
+      for (std::size_t i = 0; i < v.rows; ++i)
+        if (v.good(i)) add(v.year[i], v.month[i], v.day[i], v.temperature[i]);
+    } else {
+      std::vector<std::uint32_t> selection;
+      opt.where.select(v, selection);
+      for (std::uint32_t i : selection)
+        if (v.good(i)) add(v.year[i], v.month[i], v.day[i], v.temperature[i]);
+    }
+  } else {
+    const fs::path text_path = opt.clean_dir / (city + ".csv");
+    std::ifstream input(text_path);
+    if (!input.is_open()) {
+      std::cerr << "Could not open " << city << ".csv\n";
+      return -1;
+    }
+    bytes += fs::file_size(text_path, ec);
+    // year;month;day;hour;temperature;lat;lon
+    std::string line;
+    std::string_view f[5];
+    while (std::getline(input, line)) {
+      int y, m, d, h;
+      double t;
+      if (splitFields(line, ';', f, 5) < 5 || !parseInt(f[0], y) ||
+          !parseInt(f[1], m) || !parseInt(f[2], d) || !parseInt(f[3], h) ||
+          !parseDouble(f[4], t))
+        continue;
+      if (!opt.where.matches(y, m, d, h) || !opt.where.temperaturePasses(t))
+        continue;
+      add(y, m, d, t);
+    }
   }
 
-  int year{std::stoi(data[0][0])};
-  double max{0};
-  double min{0};
-  double mean{0};
-  int count{0};
-  int y;
-  double t;
-  for (auto& r : data) {
-    y = std::stoi(r[0]);
-    if (y != year) {
-      output << year << "; " << max << "; " << min << "; "<< mean/count << std::endl;
-      year = y;
-      max = 0;
-      min = 0;
-      mean = 0;
-      count = 0;
+  for (auto& s : summaries) s.finish();
+  return rows;
+}
+
+int climateMain(int argc, char* argv[]) {
+  StageReport report("climate");
+  ClimateOptions opt;
+  std::vector<std::string> cities;
+  StationSelection selection;
+  std::string error;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--monthly") {
+      opt.monthly = true;
+    } else if (arg == "--daily") {
+      opt.daily = true;
+    } else if (arg == "-j" && i + 1 < argc) {
+      opt.threads = parseThreads(argv[++i]);
+    } else if (arg == "--where" && i + 1 < argc) {
+      if (!opt.where.compile(argv[++i], error)) {
+        std::cerr << "--where: " << error << "\n";
+        return 1;
+      }
+    } else if (selection.parseArg(i, argc, argv, error)) {
+      if (!error.empty()) {
+        std::cerr << error << "\n";
+        return 1;
+      }
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::cerr << "Usage: " << argv[0]
+                << " [City.csv ...] [--monthly] [--daily] [-j N]"
+                   " [--where EXPR] "
+                << StationSelection::kUsage << std::endl;
+      return 1;
+    } else {
+      cities.push_back(fs::path(arg).stem().string());
     }
-    t = std::stod(r[4]);
-    if (t < min) {
-      min = t;
+  }
+
+  if (selection.active() &&
+      !selection.selectNames("datasets/stations.csv", cities, error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  if (cities.empty() && !selection.active()) {
+    if (!fs::is_directory(opt.clean_dir)) {
+      std::cerr << "Input directory not found: " << opt.clean_dir << "\n";
+      return 1;
     }
-    if (t > max) {
-      max = t;
+    for (const auto& entry : fs::directory_iterator(opt.clean_dir))
+      if (entry.path().extension() == ".csv")
+        cities.push_back(entry.path().stem().string());
+    std::sort(cities.begin(), cities.end());
+  }
+  cities.erase(std::remove_if(cities.begin(), cities.end(),
+                              [&](const std::string& city) {
+                                return !opt.where.matchesStation(city);
+                              }),
+               cities.end());
+
+  fs::create_directories(opt.out_dir);
+  if (opt.monthly) fs::create_directories(opt.out_dir / "monthly");
+  if (opt.daily) fs::create_directories(opt.out_dir / "daily");
+
+  std::vector<long> rows(cities.size());
+  std::vector<std::uintmax_t> bytes(cities.size());
+  {
+    ScopedPhase phase(report, "aggregate");
+    parallelFor(cities.size(), opt.threads, [&](std::size_t i) {
+      rows[i] = summarizeStation(cities[i], opt, bytes[i]);
+    });
+    for (std::size_t i = 0; i < cities.size(); ++i) {
+      if (rows[i] > 0) phase.addRows(rows[i]);
+      phase.addBytes(bytes[i]);
     }
-    mean += t;
-    count++;
   }
-  output << year << "; " << max << "; " << min << "; "<< mean/count << std::endl;
 
-  output.close();
+  int failed = 0;
+  for (std::size_t i = 0; i < cities.size(); ++i) {
+    if (rows[i] < 0) {
+      ++failed;
+      continue;
+    }
+    std::cout << "Data written to " << cities[i] << ".csv (" << rows[i]
+              << " rows)\n";
+  }
+  report.write();
+  return failed == 0 ? 0 : 1;
+}
 
-  std::cout << "Data written to " << city <<"\n";
-  return 0;
-}
\ No newline at end of file
+#ifndef PIPELINE_DRIVER
+int main(int argc, char* argv[]) { return climateMain(argc, argv); }
+#endif
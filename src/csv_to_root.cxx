@@ -1,110 +1,430 @@
 #include <TFile.h>
+#include <TNamed.h>
+#include <TParameter.h>
+#include <TROOT.h>
 #include <TTree.h>
+#include <glob.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
-// Full usage: 
-// g++ csv_to_root.cxx $(root-config --cflags --libs) -o csv_to_root 
-// ./csv_to_root input.csv [output.root] 
-// TFile *f = TFile::Open("file.root") 
-// TTree *temps = (TTree*)f->Get("temps") 
+#include "csv_to_root.h"
+#include "instrument.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "parse_utils.h"
+
+// Full usage:
+// g++ -O2 -pthread -Iinclude csv_to_root.cxx $(root-config --cflags --libs) -o csv_to_root
+// ./csv_to_root input.csv [output.root] [--mmap] [-j N]
+// ./csv_to_root [--mmap] [-j N] datasets/Climate 'datasets/Solar/*.csv' ...
+// TFile *f = TFile::Open("file.root")
+// TTree *temps = (TTree*)f->Get("temps")
 // temps->Draw("temperature:year")
+// f->Get<TParameter<double>>("latitude")->GetVal()
+//
+// By default the input is read line by line. With --mmap the file is memory
+// mapped, cut into newline-aligned chunks and the chunks are parsed on N
+// worker threads (default: all cores), at most 2 N chunks ahead of the
+// tree. The tree is always filled in the original row order, so both modes
+// write identical files. Lines that do not parse are reported and skipped.
+//
+// Given directories, globs or several CSV files, all of them are converted
+// in this one process by a pool of at most N threads, each writing
+// <name>.root next to its input. Directories and globs leave out the
+// <city>_points.csv files that b-days writes into datasets/B-days.
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " input.csv [output.root]" << std::endl;
-        return 1;
-    }
+namespace fs = std::filesystem;
 
-    std::string inputFile = argv[1];
-    std::string outputFile;
+// Owns the "temps" tree and its branch variables. The branches are chosen by
+// the first row: hourly files get narrow integer time fields and a float
+// temperature, yearly files get year plus the three summary columns. The
+// station position is the same on every hourly row, so it is kept out of the
+// tree and written once per file as the "latitude"/"longitude" parameters.
+struct TreeWriter {
+    TTree *tree;
+    Layout layout = Layout::Unknown;
+    long mismatched = 0;
+    long skipped = 0;  // lines that did not parse
 
-    if (argc >= 3)
-        outputFile = argv[2];
-    else
-        outputFile = inputFile.substr(0, inputFile.find_last_of(".")) + ".root";
+    // Hourly branches
+    Short_t year = 0;
+    UChar_t month = 0, day = 0, hour = 0;
+    Float_t temperature = 0;
 
-    std::ifstream infile(inputFile);
-    if (!infile.is_open()) {
-        std::cerr << "❌ Error: could not open file " << inputFile << std::endl;
-        return 1;
-    }
+    // Yearly branches
+    Double_t max_temp = 0, min_temp = 0, mean_temp = 0;
 
-    TFile *outfile = new TFile(outputFile.c_str(), "RECREATE");
-    TTree *tree = new TTree("temps", "Climate data from CSV");
+    // Per-file station metadata
+    double latitude = 0, longitude = 0;
+    long positions = 0;
 
-    // Variables for full CSV
-    int year=0, month=0, day=0, hour=0;
-    double temperature=0, longitude=0, latitude=0;
+    explicit TreeWriter(TTree *t) : tree{t} {}
 
-    // Variables for minimal CSV
-    double max_temp=0, min_temp=0, mean_temp=0;
+    void createBranches(Layout l) {
+        layout = l;
+        tree->Branch("year", &year, "year/S");
+        if (layout == Layout::Hourly) {
+            tree->SetTitle("Hourly station temperatures");
+            tree->Branch("month", &month, "month/b");
+            tree->Branch("day", &day, "day/b");
+            tree->Branch("hour", &hour, "hour/b");
+            tree->Branch("temperature", &temperature, "temperature/F");
+        } else {
+            tree->SetTitle("Yearly temperature summary");
+            tree->Branch("max_temp", &max_temp, "max_temp/D");
+            tree->Branch("min_temp", &min_temp, "min_temp/D");
+            tree->Branch("mean_temp", &mean_temp, "mean_temp/D");
+        }
+    }
 
-    // Create branches for both possibilities
-    tree->Branch("year", &year, "year/I");
-    tree->Branch("month", &month, "month/I");
-    tree->Branch("day", &day, "day/I");
-    tree->Branch("hour", &hour, "hour/I");
-    tree->Branch("temperature", &temperature, "temperature/D");
-    tree->Branch("longitude", &longitude, "longitude/D");
-    tree->Branch("latitude", &latitude, "latitude/D");
+    // Returns false (and skips the row) if it does not match the file's layout
+    bool fill(const Row &r) {
+        if (layout == Layout::Unknown) createBranches(r.layout);
+        if (r.layout != layout) {
+            ++mismatched;
+            return false;
+        }
+        year = static_cast<Short_t>(r.year);
+        if (layout == Layout::Hourly) {
+            month = static_cast<UChar_t>(r.month);
+            day = static_cast<UChar_t>(r.day);
+            hour = static_cast<UChar_t>(r.hour);
+            temperature = static_cast<Float_t>(r.temperature);
+            if (positions == 0 || r.latitude != latitude || r.longitude != longitude) {
+                latitude = r.latitude;
+                longitude = r.longitude;
+                ++positions;
+            }
+        } else {
+            max_temp = r.max_temp;
+            min_temp = r.min_temp;
+            mean_temp = r.mean_temp;
+        }
+        tree->Fill();
+        return true;
+    }
 
-    tree->Branch("max_temp", &max_temp, "max_temp/D");
-    tree->Branch("min_temp", &min_temp, "min_temp/D");
-    tree->Branch("mean_temp", &mean_temp, "mean_temp/D");
+    // Writes the station metadata into the current directory
+    void writeMetadata() const {
+        TNamed("layout", layout == Layout::Hourly   ? "hourly"
+                         : layout == Layout::Yearly ? "yearly"
+                                                    : "empty")
+            .Write();
+        if (layout != Layout::Hourly) return;
+        // If the station was moved we keep its latest position
+        TParameter<double>("latitude", latitude).Write();
+        TParameter<double>("longitude", longitude).Write();
+        if (positions > 1)
+            std::cerr << "⚠️ Station position changes " << positions - 1
+                      << " times, storing the last one" << std::endl;
+    }
+};
 
+// Line by line reader, see tokenizeRow()
+static long readStream(std::ifstream &infile, TreeWriter &writer) {
     std::string line;
     long nLines = 0;
+    Row row;
 
     while (std::getline(infile, line)) {
         if (line.empty()) continue;
 
-        std::stringstream ss(line);
-        std::string token;
-        std::vector<std::string> tokens;
-
-        // Split line into tokens
-        while (std::getline(ss, token, ';')) {
-            tokens.push_back(token);
+        if (!tokenizeRow(line, row)) {
+            std::cerr << "⚠️ Skipping malformed line: " << line << std::endl;
+            ++writer.skipped;
+            continue;
         }
 
-        if (tokens.size() == 7) {
-            // Full CSV
-            year = std::stoi(tokens[0]);
-            month = std::stoi(tokens[1]);
-            day = std::stoi(tokens[2]);
-            hour = std::stoi(tokens[3]);
-            temperature = std::stod(tokens[4]);
-            longitude = std::stod(tokens[5]);
-            latitude = std::stod(tokens[6]);
-
-            max_temp = min_temp = 0; // unused
+        if (writer.fill(row)) ++nLines;
+    }
+    return nLines;
+}
+
+// Rows of one chunk of the mapped file, in file order
+struct ParsedChunk {
+    std::vector<Row> rows;
+    std::vector<std::string_view> skipped;
+};
+
+// Chunks of at most about this size, so that the chunks parsed ahead of the
+// tree take little memory however large the file is
+constexpr std::size_t kChunkBytes = 4 << 20;
+
+// Memory mapped reader: chunks are parsed in parallel and filled in order
+// by this thread as soon as they are ready. A worker does not start a chunk
+// more than `ahead` chunks past the last one filled, so only those are held.
+static long readMapped(const MappedFile &file, unsigned threads, TreeWriter &writer) {
+    const std::string_view text = file.view();
+    // A few chunks per thread keeps the threads busy if chunks parse unevenly
+    const std::vector<std::string_view> chunks = splitChunks(
+        text, std::max<std::size_t>(threads * 4, text.size() / kChunkBytes));
+    const std::size_t ahead = 2 * static_cast<std::size_t>(threads);
+
+    // Chunk i waits in slot i % ahead until it is filled
+    std::vector<ParsedChunk> slots(ahead);
+    std::vector<char> ready(ahead, 0);
+    std::size_t filled = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() {
+        for (std::size_t i = next++; i < chunks.size(); i = next++) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return i < filled + ahead; });
+            }
+            ParsedChunk out;
+            out.rows.reserve(chunks[i].size() / 32);
+            Row row;
+            forEachLine(chunks[i], [&](std::string_view line) {
+                if (line.empty()) return;
+                if (parseRow(line, row))
+                    out.rows.push_back(row);
+                else
+                    out.skipped.push_back(line);
+            });
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slots[i % ahead] = std::move(out);
+                ready[i % ahead] = 1;
+            }
+            changed.notify_all();
         }
-        else if (tokens.size() == 4) {
-            // Minimal CSV
-            year = std::stoi(tokens[0]);
-            max_temp = std::stod(tokens[1]);
-            min_temp = std::stod(tokens[2]);
-            mean_temp = std::stod(tokens[3]);
-
-            month = day = hour = 0;
-            temperature = longitude = latitude = 0;
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; ++t) pool.emplace_back(worker);
+
+    long nLines = 0;
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        ParsedChunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return ready[i % ahead] != 0; });
+            chunk = std::move(slots[i % ahead]);
+            ready[i % ahead] = 0;
+            ++filled;
         }
-        else {
-            std::cerr << "⚠️ Skipping line with unexpected column count: " << line << std::endl;
-            continue;
+        changed.notify_all();
+        for (auto line : chunk.skipped)
+            std::cerr << "⚠️ Skipping malformed line: " << line << std::endl;
+        writer.skipped += chunk.skipped.size();
+        for (const auto &row : chunk.rows)
+            if (writer.fill(row)) ++nLines;
+    }
+    for (auto &t : pool) t.join();
+    return nLines;
+}
+
+// What happened to one input file, reported in the summary
+struct ConvertResult {
+    std::string input, output;
+    long rows = 0;
+    std::uintmax_t bytes = 0;
+    double seconds = 0;
+    bool ok = false;
+};
+
+static ConvertResult convertFile(const std::string &inputFile,
+                                 const std::string &outputFile,
+                                 bool useMmap, unsigned threads,
+                                 StageReport &report) {
+    ConvertResult result;
+    result.input = inputFile;
+    result.output = outputFile;
+
+    std::ifstream infile;
+    MappedFile mapped;
+    if (useMmap)
+        mapped = MappedFile(inputFile);
+    else
+        infile.open(inputFile);
+    if (useMmap ? !mapped.is_open() : !infile.is_open()) {
+        std::cerr << "❌ Error: could not open file " << inputFile << std::endl;
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    TFile *outfile = new TFile(outputFile.c_str(), "RECREATE");
+    if (outfile->IsZombie()) {
+        std::cerr << "❌ Error: could not create " << outputFile << std::endl;
+        delete outfile;
+        return result;
+    }
+    TTree *tree = new TTree("temps", "Climate data from CSV");
+    TreeWriter writer(tree);
+    const std::string name = fs::path(inputFile).filename().string();
+    std::error_code ec;
+    result.bytes = fs::file_size(inputFile, ec);
+
+    {
+        ScopedPhase phase(report, "parse+fill " + name);
+        result.rows = useMmap ? readMapped(mapped, threads, writer)
+                              : readStream(infile, writer);
+        phase.addRows(result.rows);
+        phase.addBytes(result.bytes);
+    }
+
+    if (writer.skipped > 0)
+        std::cerr << "⚠️ " << inputFile << ": skipped " << writer.skipped
+                  << " malformed lines" << std::endl;
+    if (writer.mismatched > 0)
+        std::cerr << "⚠️ " << inputFile << ": skipped " << writer.mismatched
+                  << " rows whose column count differs from the first row" << std::endl;
+
+    {
+        ScopedPhase phase(report, "write " + name);
+        outfile->cd();
+        writer.writeMetadata();
+        outfile->Write();
+        outfile->Close();
+        delete outfile;  // also deletes the tree
+    }
+
+    result.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start).count();
+    result.ok = true;
+    return result;
+}
+
+static bool hasGlobChars(const std::string &s) {
+    return s.find_first_of("*?[") != std::string::npos;
+}
+
+// Expands directories (every *.csv inside) and glob patterns into a sorted
+// list of CSV files
+// The <city>_points.csv results of b-days next to the B-days station files
+// (year;month;day;avg) are outputs, not station data
+static bool isBirthdayPoints(const fs::path &file) {
+    const std::string stem = file.stem().string();
+    const std::string suffix = "_points";
+    return stem.size() > suffix.size() &&
+           stem.compare(stem.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static std::vector<std::string> expandInputs(const std::vector<std::string> &args) {
+    std::vector<std::string> files;
+    for (const auto &arg : args) {
+        if (fs::is_directory(arg)) {
+            std::vector<std::string> inDir;
+            for (const auto &entry : fs::directory_iterator(arg))
+                if (entry.is_regular_file() && entry.path().extension() == ".csv" &&
+                    !isBirthdayPoints(entry.path()))
+                    inDir.push_back(entry.path().string());
+            std::sort(inDir.begin(), inDir.end());
+            files.insert(files.end(), inDir.begin(), inDir.end());
+        } else if (hasGlobChars(arg)) {
+            glob_t matches;
+            if (glob(arg.c_str(), 0, nullptr, &matches) == 0) {
+                for (std::size_t i = 0; i < matches.gl_pathc; ++i)
+                    if (!isBirthdayPoints(matches.gl_pathv[i]))
+                        files.emplace_back(matches.gl_pathv[i]);
+            } else {
+                std::cerr << "⚠️ No files match " << arg << std::endl;
+            }
+            globfree(&matches);
+        } else {
+            files.push_back(arg);
         }
+    }
+    return files;
+}
 
-        tree->Fill();
-        ++nLines;
+static std::string rootNameFor(const std::string &csv) {
+    return csv.substr(0, csv.find_last_of(".")) + ".root";
+}
+
+int csvToRootMain(int argc, char* argv[]) {
+    bool useMmap = false;
+    unsigned threads = defaultThreads();
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--mmap") useMmap = true;
+        else if (arg == "-j" && i + 1 < argc) threads = parseThreads(argv[++i]);
+        else args.push_back(arg);
+    }
+
+    if (args.empty()) {
+        std::cerr << "Usage: " << argv[0] << " input.csv [output.root] [--mmap] [-j N]\n"
+                  << "       " << argv[0] << " [--mmap] [-j N] dir|glob|file.csv ..." << std::endl;
+        return 1;
+    }
+
+    StageReport report("csv_to_root");
+
+    // Single file with an explicit output name, the original interface
+    if (args.size() == 2 && fs::path(args[1]).extension() == ".root") {
+        ConvertResult r = convertFile(args[0], args[1], useMmap, threads, report);
+        report.write();
+        if (!r.ok) return 1;
+        std::cout << "Wrote " << r.rows << " rows to " << r.output << " in "
+                  << r.seconds << " s (" << (r.seconds > 0 ? r.rows / r.seconds : 0)
+                  << " rows/s, " << (useMmap ? "mmap, " + std::to_string(threads) + " threads" : "stream")
+                  << ")" << std::endl;
+        return 0;
     }
 
-    outfile->Write();
-    outfile->Close();
+    // Batch mode: every input gets <name>.root next to it. Files are spread
+    // over the worker threads; if there are fewer files than threads the rest
+    // go to the chunk-parallel parsing of each file.
+    std::vector<std::string> inputs = expandInputs(args);
+    if (inputs.empty()) {
+        std::cerr << "❌ Error: no input files" << std::endl;
+        return 1;
+    }
+    if (inputs.size() > 1) ROOT::EnableThreadSafety();
+
+    const unsigned fileThreads = std::min<std::size_t>(threads, inputs.size());
+    const unsigned parseThreadsPerFile = std::max(1u, threads / fileThreads);
 
-    std::cout << "Wrote " << nLines << " rows to " << outputFile << std::endl;
-    return 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<ConvertResult> results(inputs.size());
+    parallelFor(inputs.size(), fileThreads, [&](std::size_t i) {
+        results[i] = convertFile(inputs[i], rootNameFor(inputs[i]), useMmap,
+                                 parseThreadsPerFile, report);
+    });
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start).count();
+
+    long totalRows = 0;
+    std::uintmax_t totalBytes = 0;
+    int failed = 0;
+    for (const auto &r : results) {
+        if (!r.ok) {
+            ++failed;
+            continue;
+        }
+        totalRows += r.rows;
+        totalBytes += r.bytes;
+        std::cout << "Converted " << r.input << " → " << r.output << ": "
+                  << r.rows << " rows, " << r.bytes / 1024 << " KiB, "
+                  << r.seconds << " s" << std::endl;
+    }
+
+    std::cout << "Converted " << results.size() - failed << " of "
+              << results.size() << " files with " << fileThreads << " threads: "
+              << totalRows << " rows, " << totalBytes / (1024.0 * 1024.0)
+              << " MiB in " << seconds << " s ("
+              << (seconds > 0 ? totalRows / seconds : 0) << " rows/s, "
+              << (seconds > 0 ? totalBytes / (1024.0 * 1024.0) / seconds : 0)
+              << " MiB/s)" << std::endl;
+    report.write();
+    return failed == 0 ? 0 : 1;
 }
+
+#ifndef PIPELINE_DRIVER
+int main(int argc, char* argv[]) { return csvToRootMain(argc, argv); }
+#endif
@@ -0,0 +1,258 @@
+#include "filter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "parse_utils.h"
+
+namespace {
+
+// Rows are tested in blocks of this size: first a byte mask is computed for
+// the whole block column by column, then the mask is turned into indices.
+// A batch never crosses a zone map block.
+constexpr std::size_t kBatch = kZoneRows;
+
+// Calls fn(lo, hi) for each "A" or "A-B" item of a comma separated list.
+// Returns false if an item is not a number or range.
+template <typename Fn>
+bool forEachRange(std::string_view values, Fn&& fn) {
+  if (values.empty()) return false;
+  std::size_t start = 0;
+  while (start <= values.size()) {
+    std::size_t end = values.find(',', start);
+    if (end == std::string_view::npos) end = values.size();
+    std::string_view item = values.substr(start, end - start);
+    // A leading '-' would be a negative number, look for the dash after it
+    std::size_t dash = item.find('-', 1);
+    int lo, hi;
+    if (dash == std::string_view::npos) {
+      if (!parseInt(item, lo)) return false;
+      hi = lo;
+    } else if (!parseInt(item.substr(0, dash), lo) ||
+               !parseInt(item.substr(dash + 1), hi)) {
+      return false;
+    }
+    if (lo > hi) std::swap(lo, hi);
+    fn(lo, hi);
+    start = end + 1;
+  }
+  return true;
+}
+
+// Sets table[v] = 1 for every listed value in [0, size)
+bool fillTable(std::uint8_t* table, int size, std::string_view values) {
+  std::memset(table, 0, size);
+  return forEachRange(values, [&](int lo, int hi) {
+    for (int v = std::max(lo, 0); v <= hi && v < size; ++v) table[v] = 1;
+  });
+}
+
+}  // namespace
+
+Filter::Filter() {
+  std::memset(m_hour, 1, sizeof m_hour);
+  std::memset(m_month, 1, sizeof m_month);
+  std::memset(m_day, 1, sizeof m_day);
+  std::memset(m_date, 1, sizeof m_date);
+  std::memset(m_quality, 1, sizeof m_quality);
+}
+
+bool Filter::parseClause(std::string_view clause, std::string& error) {
+  std::size_t eq = clause.find('=');
+  if (eq == std::string_view::npos) {
+    error = "expected key=values, got '" + std::string(clause) + "'";
+    return false;
+  }
+  std::string_view key = clause.substr(0, eq);
+  std::string_view values = clause.substr(eq + 1);
+  bool ok = true;
+
+  if (key == "hour") {
+    ok = fillTable(m_hour, 256, values);
+  } else if (key == "month") {
+    ok = fillTable(m_month, 256, values);
+  } else if (key == "day") {
+    ok = fillTable(m_day, 256, values);
+  } else if (key == "year") {
+    m_years.clear();
+    ok = forEachRange(values,
+                      [&](int lo, int hi) { m_years.emplace_back(lo, hi); });
+  } else if (key == "date") {
+    std::memset(m_date, 0, sizeof m_date);
+    m_has_date = true;
+    std::size_t start = 0;
+    while (ok && start <= values.size()) {
+      std::size_t end = values.find(',', start);
+      if (end == std::string_view::npos) end = values.size();
+      std::string_view date = values.substr(start, end - start);
+      std::size_t dash = date.find('-');
+      int month, day;
+      ok = dash != std::string_view::npos &&
+           parseInt(date.substr(0, dash), month) &&
+           parseInt(date.substr(dash + 1), day) && month >= 1 &&
+           month <= 12 && day >= 1 && day <= 31;
+      if (ok) m_date[month * 32 + day] = 1;
+      start = end + 1;
+    }
+  } else if (key == "station") {
+    m_stations.clear();
+    std::size_t start = 0;
+    while (start <= values.size()) {
+      std::size_t end = values.find(',', start);
+      if (end == std::string_view::npos) end = values.size();
+      m_stations.emplace_back(values.substr(start, end - start));
+      start = end + 1;
+    }
+  } else if (key == "temp") {
+    // LO..HI, either side optional
+    std::size_t dots = values.find("..");
+    double lo = -1e30, hi = 1e30;
+    ok = dots != std::string_view::npos &&
+         (dots == 0 || parseDouble(values.substr(0, dots), lo)) &&
+         (dots + 2 == values.size() ||
+          parseDouble(values.substr(dots + 2), hi));
+    if (ok) {
+      m_has_temperature = true;
+      m_temperature_lo = static_cast<float>(std::min(lo, hi));
+      m_temperature_hi = static_cast<float>(std::max(lo, hi));
+    }
+  } else if (key == "quality") {
+    std::memset(m_quality, 0, sizeof m_quality);
+    std::size_t start = 0;
+    while (ok && start <= values.size()) {
+      std::size_t end = values.find(',', start);
+      if (end == std::string_view::npos) end = values.size();
+      std::string_view code = values.substr(start, end - start);
+      ok = code.size() == 1;
+      if (ok) m_quality[static_cast<unsigned char>(code[0])] = 1;
+      start = end + 1;
+    }
+  } else {
+    error = "unknown filter key '" + std::string(key) + "'";
+    return false;
+  }
+
+  if (!ok) error = "bad values in '" + std::string(clause) + "'";
+  return ok;
+}
+
+bool Filter::compile(const std::string& expr, std::string& error) {
+  Filter compiled;
+  compiled.m_expr = expr;
+  std::string_view rest = expr;
+  while (!(rest = trim(rest, " \t")).empty()) {
+    std::size_t end = rest.find_first_of(" \t");
+    if (end == std::string_view::npos) end = rest.size();
+    if (!compiled.parseClause(rest.substr(0, end), error)) return false;
+    rest.remove_prefix(end);
+  }
+  *this = compiled;
+  return true;
+}
+
+bool Filter::matchesStation(std::string_view name) const {
+  if (m_stations.empty()) return true;
+  return std::find(m_stations.begin(), m_stations.end(), name) !=
+         m_stations.end();
+}
+
+bool Filter::mayMatch(const ZoneMap& z) const {
+  if (z.rows == 0) return false;
+
+  if (!m_years.empty()) {
+    const int first = z.time_min / 1000000, last = z.time_max / 1000000;
+    bool any = false;
+    for (const auto& [lo, hi] : m_years) any |= lo <= last && hi >= first;
+    if (!any) return false;
+  }
+
+  bool any_hour = false;
+  for (int h = z.hour_min; h <= z.hour_max && !any_hour; ++h)
+    any_hour = m_hour[h];
+  if (!any_hour) return false;
+
+  // Months and days: the block's MMDD range is exact when it lies within
+  // one year, otherwise only the months are known
+  int first = 100, last = 1231;
+  if (z.time_min / 1000000 == z.time_max / 1000000) {
+    first = z.time_min / 100 % 10000;
+    last = z.time_max / 100 % 10000;
+  }
+  bool any_date = false;
+  for (int m = z.month_min; m <= z.month_max && !any_date; ++m) {
+    if (!m_month[m]) continue;
+    const int day_lo = m == first / 100 ? first % 100 : 0;
+    const int day_hi = m == last / 100 ? last % 100 : 31;
+    for (int d = day_lo; d <= day_hi && !any_date; ++d)
+      any_date = m_day[d] && (!m_has_date || m > 15 || m_date[m * 32 + d]);
+  }
+  if (!any_date) return false;
+
+  if (m_has_temperature && (z.temperature_max < m_temperature_lo ||
+                            z.temperature_min > m_temperature_hi))
+    return false;
+
+  // Only the count of G rows is kept, other codes could be any
+  if (z.good > 0 && m_quality[static_cast<unsigned char>('G')]) return true;
+  if (z.good < z.rows)
+    for (int q = 0; q < 256; ++q)
+      if (q != 'G' && m_quality[q]) return true;
+  return false;
+}
+
+std::size_t Filter::candidateBlocks(const StationView& v) const {
+  if (!v.zones) return v.blocks();
+  std::size_t n = 0;
+  for (std::size_t b = 0; b < v.blocks(); ++b) n += mayMatch(v.zones[b]);
+  return n;
+}
+
+std::size_t Filter::select(const StationView& v, std::size_t begin,
+                           std::size_t end,
+                           std::vector<std::uint32_t>& selection) const {
+  const std::size_t before = selection.size();
+  end = std::min(end, v.rows);
+  std::uint8_t mask[kBatch];
+
+  const bool one_year_range = m_years.size() == 1;
+  const int year_lo = one_year_range ? m_years[0].first : 0;
+  const unsigned year_span =
+      one_year_range
+          ? static_cast<unsigned>(m_years[0].second - m_years[0].first)
+          : 0;
+
+  for (std::size_t b = begin, next; b < end; b = next) {
+    next = std::min(end, (b / kZoneRows + 1) * kZoneRows);
+    if (v.zones && !mayMatch(v.zones[b / kZoneRows])) continue;
+    const std::size_t n = next - b;
+    const std::uint8_t* hour = v.hour + b;
+    const std::uint8_t* month = v.month + b;
+    const std::uint8_t* day = v.day + b;
+    const char* quality = v.quality + b;
+    const std::int16_t* year = v.year + b;
+    const float* temperature = v.temperature + b;
+
+    // Table lookups only, no branches, so the compiler can unroll this
+    for (std::size_t i = 0; i < n; ++i)
+      mask[i] = m_hour[hour[i]] & m_month[month[i]] & m_day[day[i]] &
+                m_quality[static_cast<unsigned char>(quality[i])];
+    if (m_has_date)
+      for (std::size_t i = 0; i < n; ++i)
+        mask[i] &= m_date[(month[i] & 15) * 32 + (day[i] & 31)];
+    if (one_year_range) {
+      for (std::size_t i = 0; i < n; ++i)
+        mask[i] &= static_cast<unsigned>(year[i] - year_lo) <= year_span;
+    } else if (!m_years.empty()) {
+      for (std::size_t i = 0; i < n; ++i)
+        mask[i] &= yearPasses(year[i]);
+    }
+    if (m_has_temperature)
+      for (std::size_t i = 0; i < n; ++i)
+        mask[i] &= (temperature[i] >= m_temperature_lo) &
+                   (temperature[i] <= m_temperature_hi);
+
+    for (std::size_t i = 0; i < n; ++i)
+      if (mask[i]) selection.push_back(static_cast<std::uint32_t>(b + i));
+  }
+  return selection.size() - before;
+}
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "parallel.h"
+#include "solar.h"  // isLeap, dayOfYear
+
+// Usage:
+// g++ -O2 -pthread -Iinclude src/gen_smhi.cxx -o build/gen_smhi
+// ./build/gen_smhi OUT_DIR [--stations N] [--years Y] [--last-year Y]
+//                  [--hourly-from Y] [--gap-rate P] [--seed S] [-j N]
+//                  [--estimate]
+//
+// Writes N synthetic station files in the format of the SMHI open data
+// downloads in raw/datasets.tgz, as smhi-opendata_1_<id>_<date>_SynthNNNNN.csv,
+// for scaling tests of the pipeline:
+//   - the header block with station name, parameter and one metadata line
+//     "from;to;height;lat;lon" per position (some stations move once)
+//   - "YYYY-MM-DD;HH:MM:SS;value;code" rows over the last Y years (default
+//     60, up to --last-year, default 2024), three readings a day (06, 12 and
+//     18 UTC) before --hourly-from (default 1961) and hourly after
+//   - quality codes G (about 97%) and Y, as in the real files
+//   - gaps: with probability P (default 0.05) per station and year an
+//     outage of up to three months, and single missing readings
+// Temperatures follow a seasonal and daily cycle that depends on latitude,
+// a warming trend and autocorrelated noise. The output only depends on the
+// options and the seed, not on the thread count. --estimate prints the size
+// of the data set without writing it.
+//
+// An hourly station-year is about 8760 rows and 250 kB, so 1000 stations of
+// 60 years are about 15 GB.
+
+namespace fs = std::filesystem;
+
+struct GenOptions {
+  fs::path out_dir;
+  int stations = 100;
+  int years = 60;
+  int last_year = 2024;
+  int hourly_from = 1961;
+  double gap_rate = 0.05;
+  std::uint64_t seed = 12345;
+  unsigned threads = defaultThreads();
+  bool estimate = false;
+};
+
+struct GenResult {
+  std::uint64_t rows = 0, bytes = 0;
+  bool ok = false;
+};
+
+static const int kDaysInMonth[] = {0, 31, 28, 31, 30, 31, 30,
+                                   31, 31, 30, 31, 30, 31};
+
+static void appendDigits(std::string& out, int value, int width) {
+  char digits[12];
+  for (int i = width - 1; i >= 0; --i) {
+    digits[i] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  }
+  out.append(digits, width);
+}
+
+// Temperature in tenths of a degree, "-3.5", "12.0"
+static void appendTenths(std::string& out, int tenths) {
+  if (tenths < 0) {
+    out += '-';
+    tenths = -tenths;
+  }
+  out += std::to_string(tenths / 10);
+  out += '.';
+  out += static_cast<char>('0' + tenths % 10);
+}
+
+// Rows of one station without gaps, for --estimate
+static std::uint64_t fullRows(const GenOptions& opt) {
+  std::uint64_t rows = 0;
+  for (int y = opt.last_year - opt.years + 1; y <= opt.last_year; ++y)
+    rows += static_cast<std::uint64_t>(isLeap(y) ? 366 : 365) *
+            (y < opt.hourly_from ? 3 : 24);
+  return rows;
+}
+
+static std::string stationName(int index) {
+  char name[24];
+  std::snprintf(name, sizeof name, "Synth%05d", index);
+  return name;
+}
+
+static GenResult writeStation(int index, const GenOptions& opt) {
+  GenResult result;
+  // One generator per station, so the files do not depend on the threads
+  std::mt19937_64 rng(opt.seed * 0x9e3779b97f4a7c15ull +
+                      static_cast<std::uint64_t>(index));
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+
+  const std::string name = stationName(index);
+  const int id = 90000 + index;
+  const int first_year = opt.last_year - opt.years + 1;
+  double lat = 55.3 + 13.8 * uniform(rng);
+  double lon = 11.0 + 13.2 * uniform(rng);
+  const double height = std::round(400.0 * uniform(rng) * uniform(rng));
+
+  char file_name[96];
+  std::snprintf(file_name, sizeof file_name,
+                "smhi-opendata_1_%d_%d1231_%s.csv", id, opt.last_year,
+                name.c_str());
+  std::ofstream out(opt.out_dir / file_name, std::ios::binary);
+  if (!out) {
+    std::cerr << "Could not write " << opt.out_dir / file_name << "\n";
+    return result;
+  }
+
+  std::string text;
+  text.reserve(1 << 23);
+  char line[160];
+  std::snprintf(line, sizeof line,
+                "Stationsnamn;Klimatnummer;Mätstationens höjd (meter)\n"
+                "%s;%d;%.1f\n\n",
+                name.c_str(), id, height);
+  text += line;
+  text +=
+      "Parameternamn;Beskrivning;Enhet\n"
+      "Lufttemperatur;momentanvärde, 1 gång/tim;degree celsius\n\n"
+      "Tidsperiod (fr.o.m);Tidsperiod (t.o.m);Höjd (meter);"
+      "Latitud (decimalgrader);Longitud (decimalgrader)\n";
+  // A tenth of the stations moved once; the last position holds for the
+  // rows, as build/clean reads it
+  if (uniform(rng) < 0.1) {
+    const int moved = first_year + static_cast<int>(opt.years * uniform(rng));
+    std::snprintf(line, sizeof line,
+                  "%d-01-01 00:00:00;%d-12-31 23:00:00;%.1f;%.4f;%.4f\n",
+                  first_year, moved - 1, height, lat, lon);
+    text += line;
+    lat += 0.05 * normal(rng);
+    lon += 0.05 * normal(rng);
+    std::snprintf(line, sizeof line,
+                  "%d-01-01 00:00:00;%d-12-31 23:00:00;%.1f;%.4f;%.4f\n",
+                  moved, opt.last_year, height, lat, lon);
+  } else {
+    std::snprintf(line, sizeof line,
+                  "%d-01-01 00:00:00;%d-12-31 23:00:00;%.1f;%.4f;%.4f\n",
+                  first_year, opt.last_year, height, lat, lon);
+  }
+  text += line;
+  text += "\nDatum;Tid (UTC);Lufttemperatur;Kvalitet;;Tidsutsnitt:\n";
+
+  // Climate of the station: colder and more seasonal to the north
+  const double mean = 9.0 - 0.55 * (lat - 55.0) - 0.006 * height;
+  const double seasonal = 7.5 + 0.35 * (lat - 55.0);
+  const double noise_sigma = 1.2;
+  double anomaly = 0;
+  bool first_row = true;
+
+  for (int year = first_year; year <= opt.last_year; ++year) {
+    // At most one outage per year, [gap_start, gap_end) in days of year
+    int gap_start = 0, gap_end = 0;
+    if (uniform(rng) < opt.gap_rate) {
+      gap_start = 1 + static_cast<int>(365 * uniform(rng));
+      gap_end = gap_start + 1 + static_cast<int>(90 * uniform(rng));
+    }
+    const bool hourly = year >= opt.hourly_from;
+    const double warming = 0.012 * std::max(0, year - 1900);
+
+    for (int month = 1; month <= 12; ++month) {
+      const int days = kDaysInMonth[month] + (month == 2 && isLeap(year));
+      for (int day = 1; day <= days; ++day) {
+        const int J = dayOfYear(year, month, day);
+        if (J >= gap_start && J < gap_end) continue;
+        const double season = -seasonal * std::cos(2 * PI * (J - 15) / 365.25);
+
+        for (int hour = hourly ? 0 : 6; hour < 24; hour += hourly ? 1 : 6) {
+          // Autocorrelated weather on top of the cycles
+          anomaly = 0.95 * anomaly + 0.3 * noise_sigma * normal(rng);
+          if (uniform(rng) < 0.02 * opt.gap_rate) continue;
+          const double diurnal = -3.0 * std::cos(2 * PI * (hour - 2) / 24.0);
+          const double t = mean + season + diurnal + warming + anomaly;
+          const char code = uniform(rng) < 0.03 ? 'Y' : 'G';
+
+          appendDigits(text, year, 4);
+          text += '-';
+          appendDigits(text, month, 2);
+          text += '-';
+          appendDigits(text, day, 2);
+          text += ';';
+          appendDigits(text, hour, 2);
+          text += ":00:00;";
+          appendTenths(text, static_cast<int>(std::lround(10 * t)));
+          text += ';';
+          text += code;
+          text += first_row ? ";;Kvalitetskontrollerade historiska data\n"
+                            : ";;\n";
+          first_row = false;
+          ++result.rows;
+        }
+      }
+    }
+    // Write out a year at a time, so memory stays small for long series
+    if (text.size() > (1u << 22) || year == opt.last_year) {
+      out.write(text.data(), static_cast<std::streamsize>(text.size()));
+      result.bytes += text.size();
+      text.clear();
+    }
+  }
+  result.ok = static_cast<bool>(out);
+  if (!result.ok) std::cerr << "Could not write " << file_name << "\n";
+  return result;
+}
+
+static bool parseOptions(int argc, char* argv[], GenOptions& opt) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--stations" && has_value) {
+      opt.stations = std::stoi(argv[++i]);
+    } else if (arg == "--years" && has_value) {
+      opt.years = std::stoi(argv[++i]);
+    } else if (arg == "--last-year" && has_value) {
+      opt.last_year = std::stoi(argv[++i]);
+    } else if (arg == "--hourly-from" && has_value) {
+      opt.hourly_from = std::stoi(argv[++i]);
+    } else if (arg == "--gap-rate" && has_value) {
+      opt.gap_rate = std::stod(argv[++i]);
+    } else if (arg == "--seed" && has_value) {
+      opt.seed = std::stoull(argv[++i]);
+    } else if (arg == "-j" && has_value) {
+      opt.threads = parseThreads(argv[++i]);
+    } else if (arg == "--estimate") {
+      opt.estimate = true;
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::cerr << "Unknown option " << arg << "\n";
+      return false;
+    } else if (opt.out_dir.empty()) {
+      opt.out_dir = arg;
+    } else {
+      return false;
+    }
+  }
+  return (!opt.out_dir.empty() || opt.estimate) && opt.stations > 0 &&
+         opt.stations < 100000 && opt.years > 0 && opt.gap_rate >= 0 &&
+         opt.gap_rate <= 1;
+}
+
+int main(int argc, char* argv[]) {
+  GenOptions opt;
+  if (!parseOptions(argc, argv, opt)) {
+    std::cerr << "Usage: " << argv[0]
+              << " OUT_DIR [--stations N] [--years Y] [--last-year Y]"
+                 " [--hourly-from Y] [--gap-rate P] [--seed S] [-j N]"
+                 " [--estimate]"
+              << std::endl;
+    return 1;
+  }
+
+  if (opt.estimate) {
+    // About 30 bytes per row; gaps remove a few percent
+    const double rows = static_cast<double>(fullRows(opt)) * opt.stations;
+    std::cout << opt.stations << " stations x " << opt.years << " years: about "
+              << rows / 1e6 << " M rows, " << rows * 30 / 1e9 << " GB\n";
+    return 0;
+  }
+
+  std::error_code ec;
+  fs::create_directories(opt.out_dir, ec);
+  if (!fs::is_directory(opt.out_dir)) {
+    std::cerr << "Could not create " << opt.out_dir << "\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<GenResult> results(opt.stations);
+  parallelFor(results.size(), opt.threads, [&](std::size_t i) {
+    results[i] = writeStation(static_cast<int>(i) + 1, opt);
+  });
+
+  GenResult total;
+  int failed = 0;
+  for (const GenResult& r : results) {
+    total.rows += r.rows;
+    total.bytes += r.bytes;
+    if (!r.ok) ++failed;
+  }
+  std::chrono::duration<double> s = std::chrono::steady_clock::now() - start;
+  std::cout << opt.stations - failed << " stations, " << total.rows
+            << " rows, " << total.bytes / 1e6 << " MB written to "
+            << opt.out_dir << " in " << s.count() << " s\n";
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <TFile.h>
+#include <TList.h>
+#include <TROOT.h>
+#include <TTree.h>
+
+#include "parallel.h"
+
+// The plotting macros are compiled into this driver; run on their own they
+// still work as before with root -l -b -q "src/plot_....C(...)".
+#include "plot_max_min_trends.C"
+#include "plot_mean_temp_trend.C"
+
+// Usage:
+// ./build/plot_climate [City.root ...] [-j N]
+//
+// Draws the mean and the max/min temperature trend plots of every city in
+// datasets/Climate (or only the given files) in one process: each ROOT file
+// is opened once and both plots are made from the same tree. With -j N the
+// cities are split over N forked worker processes; ROOT graphics are not
+// thread safe, processes are.
+
+namespace fs = std::filesystem;
+
+// Returns the number of cities that could not be plotted
+static int plotCities(const std::vector<fs::path> &files, std::size_t worker,
+                      std::size_t workers) {
+    int failed = 0;
+    for (std::size_t i = worker; i < files.size(); i += workers) {
+        const std::string city = files[i].stem().string();
+        TFile *f = TFile::Open(files[i].string().c_str());
+        TTree *temps = f && !f->IsZombie() ? f->Get<TTree>("temps") : nullptr;
+        if (!temps) {
+            std::cerr << "No valid TTree found in " << files[i] << std::endl;
+            ++failed;
+            if (f) f->Close();
+            continue;
+        }
+        std::cout << "Analyzing " << city << "..." << std::endl;
+        draw_mean_temp_trend(temps, city.c_str());
+        draw_max_min_trends(temps, city.c_str());
+
+        // The canvases refer to objects in the file, drop them first
+        gROOT->GetListOfCanvases()->Delete();
+        f->Close();
+        delete f;
+    }
+    return failed;
+}
+
+int plotClimateMain(int argc, char* argv[]) {
+    std::vector<fs::path> files;
+    unsigned jobs = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            jobs = parseThreads(argv[++i]);
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Usage: " << argv[0] << " [City.root ...] [-j N]" << std::endl;
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.empty()) {
+        const fs::path folder = "datasets/Climate";
+        if (!fs::is_directory(folder)) {
+            std::cerr << "Input directory not found: " << folder << std::endl;
+            return 1;
+        }
+        for (const auto& entry : fs::directory_iterator(folder))
+            if (entry.path().extension() == ".root") files.push_back(entry.path());
+        std::sort(files.begin(), files.end());
+    }
+
+    gROOT->SetBatch(kTRUE);
+    fs::create_directories("plots/mean_temps");
+    fs::create_directories("plots/max_min_temps");
+
+    const std::size_t workers = std::max<std::size_t>(
+        1, std::min<std::size_t>(jobs, files.size()));
+    if (workers == 1) return plotCities(files, 0, 1) == 0 ? 0 : 1;
+
+    // Worker w plots cities w, w + workers, ...
+    int status_all = 0;
+    std::vector<pid_t> children;
+    for (std::size_t w = 0; w < workers; ++w) {
+        pid_t pid = fork();
+        if (pid == 0) _exit(plotCities(files, w, workers) == 0 ? 0 : 1);
+        if (pid < 0) {
+            std::cerr << "fork failed, plotting share " << w << " here" << std::endl;
+            if (plotCities(files, w, workers) != 0) status_all = 1;
+            continue;
+        }
+        children.push_back(pid);
+    }
+
+    for (pid_t child : children) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) status_all = 1;
+    }
+    std::cout << "Plotted " << files.size() << " cities with " << workers
+              << " processes" << std::endl;
+    return status_all;
+}
+
+#ifndef PIPELINE_DRIVER
+int main(int argc, char* argv[]) { return plotClimateMain(argc, argv); }
+#endif
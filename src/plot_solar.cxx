@@ -2,12 +2,15 @@
 #include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <filesystem>
 #include <fstream>
+#include <initializer_list>
 #include <iostream>
 #include <limits>
 #include <map>
 #include <set>
 #include <string>
+#include <system_error>
 #include <utility>
 #include <vector>
 
@@ -21,24 +24,12 @@
 #include "TROOT.h"
 #include "TStyle.h"
 #include "TTree.h"
-#include "TVirtualFFT.h"
+#include "instrument.h"
+#include "parallel.h"
+#include "rolling.h"
+#include "solar.h"  // isLeap, dayOfYear
+#include "spectral.h"
 
-// ------------------ Calendar helpers (match your earlier logic)
-// ------------------
-inline bool isLeap(int y) {
-  return (y % 400 == 0) || (y % 4 == 0 && y % 100 != 0);
-}
-
-inline int dayOfYear(int y, int m, int d) {
-  static const int cum[12] = {0,   31,  59,  90,  120, 151,
-                              181, 212, 243, 273, 304, 334};
-  int maxd = (m == 2 ? (isLeap(y) ? 29 : 28)
-                     : (m == 4 || m == 6 || m == 9 || m == 11 ? 30 : 31));
-  if (m < 1 || m > 12 || d < 1 || d > maxd) return -1;
-  int J = cum[m - 1] + d;
-  if (m > 2 && isLeap(y)) ++J;
-  return J;
-}
 // Month names for legend
 static const char* kMonthName[13] = {"",    "Jan", "Feb", "Mar", "Apr",
                                      "May", "Jun", "Jul", "Aug", "Sep",
@@ -57,10 +48,30 @@ struct Acc {
   }
 };
 
-int solarMonthlyNorm() {
+// One station's adjusted temperatures as (fractional year, value) samples,
+// one per hourly row of the tree (the solar hours, see kSolarRowFilter).
+// Hours without data are simply absent, which the Lomb-Scargle periodogram
+// handles without any filling; its cost grows linearly with the samples.
+struct StationSeries {
+  std::string name;
+  std::vector<double> t, y;
+
+  void add(int year, int J, int hour, double v) {
+    t.push_back(year + (J - 1 + hour / 24.0) / (isLeap(year) ? 366.0 : 365.0));
+    y.push_back(v);
+  }
+};
+
+// threads = 0 uses every core for the per-station spectra. The read,
+// plots and spectra phases are timed in `report`.
+int solarMonthlyNorm(unsigned threads, StageReport& report) {
   gROOT->SetBatch(kTRUE);  // no GUI popups
+  if (threads == 0) threads = defaultThreads();
 
   const std::string in_path = "datasets/Solar/adjusted_temps.root";
+  ScopedPhase readPhase(report, "read");
+  std::error_code ec;
+  readPhase.addBytes(std::filesystem::file_size(in_path, ec));
   TFile* fin = TFile::Open(in_path.c_str(), "READ");
   if (!fin || fin->IsZombie()) {
     std::cerr << "ERROR: Cannot open ROOT file: " << in_path << "\n";
@@ -74,22 +85,36 @@ int solarMonthlyNorm() {
     return 1;
   }
 
-  // Bind branches (structure taken from your producer)
-  int year, month, day, hour;
-  double lat, lon, temp_raw, G0h, G0h_mean, correction, temp_adj;
+  // Only the columns used here are read from disk
+  int year, month, day, hour, station = 0;
+  double temp_adj;
 
+  tree->SetBranchStatus("*", false);
+  for (const char* name : {"year", "month", "day", "hour_utc", "temp_adj_C"})
+    tree->SetBranchStatus(name, true);
   tree->SetBranchAddress("year", &year);
   tree->SetBranchAddress("month", &month);
   tree->SetBranchAddress("day", &day);
   tree->SetBranchAddress("hour_utc", &hour);
-  tree->SetBranchAddress("lat_deg", &lat);
-  tree->SetBranchAddress("lon_deg", &lon);
-  tree->SetBranchAddress("temp_raw_C", &temp_raw);
-  tree->SetBranchAddress("G0h_Wm2", &G0h);
-  tree->SetBranchAddress("G0h_mean_Wm2", &G0h_mean);
-  tree->SetBranchAddress("correction_C", &correction);
   tree->SetBranchAddress("temp_adj_C", &temp_adj);
 
+  // Per-station series, if the file has the station column (solar.cxx
+  // writes it with a "stations" name list); otherwise one combined series
+  std::vector<StationSeries> stations(1);
+  stations[0].name = "all";
+  TTree* station_list = dynamic_cast<TTree*>(fin->Get("stations"));
+  if (tree->GetBranch("station") && station_list) {
+    tree->SetBranchStatus("station", true);
+    tree->SetBranchAddress("station", &station);
+    char name[64];
+    station_list->SetBranchAddress("name", name);
+    stations.resize(station_list->GetEntries());
+    for (Long64_t i = 0; i < station_list->GetEntries(); ++i) {
+      station_list->GetEntry(i);
+      stations[i].name = name;
+    }
+  }
+
   const Long64_t N = tree->GetEntries();
   if (N <= 0) {
     std::cerr << "No entries in tree.\n";
@@ -97,26 +122,41 @@ int solarMonthlyNorm() {
     return 0;
   }
 
-  // ---------- PASS 1: per-day-of-year min/max of adjusted temperatures
-  // ---------- Index day-of-year as [1..366]. We'll ignore index 0.
+  // ---------- Per-day-of-year min/max of adjusted temperatures ----------
+  // Index day-of-year as [1..366]. We'll ignore index 0.
   const int MAX_DOY = 366;
   std::vector<double> doy_min(MAX_DOY + 1,
                               std::numeric_limits<double>::infinity());
   std::vector<double> doy_max(MAX_DOY + 1,
                               -std::numeric_limits<double>::infinity());
-  std::vector<long long> doy_cnt(MAX_DOY + 1, 0);
 
-  for (Long64_t i = 0; i < N; ++i) {
-    tree->GetEntry(i);
-    const int J = dayOfYear(year, month, day);
-    if (J < 1 || J > MAX_DOY) continue;
-    doy_min[J] = std::min(doy_min[J], temp_adj);
-    doy_max[J] = std::max(doy_max[J], temp_adj);
-    ++doy_cnt[J];
+  // Written by solar.cxx next to the temps tree. Files from before it did
+  // that get an extra pass over the same columns instead.
+  TTree* summary = dynamic_cast<TTree*>(fin->Get("doy_summary"));
+  if (summary) {
+    int doy;
+    double lo, hi;
+    summary->SetBranchAddress("doy", &doy);
+    summary->SetBranchAddress("temp_adj_min_C", &lo);
+    summary->SetBranchAddress("temp_adj_max_C", &hi);
+    for (Long64_t i = 0; i < summary->GetEntries(); ++i) {
+      summary->GetEntry(i);
+      if (doy < 1 || doy > MAX_DOY) continue;
+      doy_min[doy] = lo;
+      doy_max[doy] = hi;
+    }
+  } else {
+    for (Long64_t i = 0; i < N; ++i) {
+      tree->GetEntry(i);
+      const int J = dayOfYear(year, month, day);
+      if (J < 1 || J > MAX_DOY) continue;
+      doy_min[J] = std::min(doy_min[J], temp_adj);
+      doy_max[J] = std::max(doy_max[J], temp_adj);
+    }
   }
 
-  // ---------- PASS 2: normalize each entry by its day-of-year, then monthly
-  // means ---------- Key: (year, month) -> accumulator of normalized values
+  // ---------- Normalize each entry by its day-of-year, then monthly means
+  // ---------- Key: (year, month) -> accumulator of normalized values
   std::map<std::pair<int, int>, Acc> monthly_means;
   std::set<int> years_present;  // to build time axis
 
@@ -139,9 +179,14 @@ int solarMonthlyNorm() {
 
     monthly_means[{year, month}].add(norm);
     years_present.insert(year);
+    if (station >= 0 && station < static_cast<int>(stations.size()))
+      stations[station].add(year, J, hour, temp_adj);
   }
 
   fin->Close();
+  readPhase.addRows(N);
+  readPhase.stop();
+  ScopedPhase plotPhase(report, "plots");
 
   if (monthly_means.empty()) {
     std::cerr << "No monthly data accumulated (check input branches?).\n";
@@ -315,6 +360,34 @@ int solarMonthlyNorm() {
       L->Draw("same");
     }
 
+    // 12-month running mean of the months in succession, centred, months
+    // without data as gaps (rolling.h)
+    std::vector<double> months((y_max - y_min + 1) * 12,
+                               std::numeric_limits<double>::quiet_NaN());
+    for (auto& kv : monthly_means)
+      months[monthStep(kv.first.first, kv.first.second, y_min)] =
+          kv.second.mean();
+    RollingOptions yearly;
+    yearly.window = 12;
+    const std::vector<RollingStats> smooth = rolling(months, yearly);
+    std::vector<double> xs_run, ys_run;
+    for (std::size_t i = 0; i < smooth.size(); ++i) {
+      if (!smooth[i].valid()) continue;
+      xs_run.push_back(y_min + i / 12.0);
+      ys_run.push_back(smooth[i].mean);
+    }
+    TGraph* g_run = new TGraph(static_cast<int>(xs_run.size()),
+                               xs_run.data(), ys_run.data());
+    g_run->SetName("g_monthly_norm_running");
+    g_run->SetLineColor(kRed);
+    g_run->SetLineWidth(3);
+    if (!xs_run.empty()) g_run->Draw("L same");
+
+    TLegend* leg_tl = new TLegend(0.75, 0.85, 0.97, 0.94);
+    leg_tl->AddEntry(g_tl, "Monthly mean", "lp");
+    leg_tl->AddEntry(g_run, "12-month running mean", "l");
+    leg_tl->Draw();
+
     c2->SaveAs("plots/solar/monthly_norm_temp_timeline.png");
 
     // Save into the ROOT output as well
@@ -323,6 +396,7 @@ int solarMonthlyNorm() {
     if (fout2 && !fout2->IsZombie()) {
       c2->Write("canvas_monthly_norm_timeline");
       g_tl->Write();
+      g_run->Write();
       fout2->Close();
     } else {
       std::cerr << "WARNING: Could not update monthly_norm_temp.root with "
@@ -332,57 +406,32 @@ int solarMonthlyNorm() {
     std::cerr << "No (year,month) points for the timeline plot.\n";
   }
 
+  plotPhase.stop();
+
   // ---------- Frequency analysis ----------
+  ScopedPhase spectraPhase(report, "spectra");
+  // Lomb-Scargle on the months that have data, so gaps are left out
+  // instead of being filled with zeros, up to the monthly Nyquist frequency
+  const double nyquist = 12.0 / 2.0;  // cycles per year
   {
-    // Build uniform monthly series (year + month → index)
-    int y_min = years_sorted.front();
-    int y_max = years_sorted.back();
-    int n_months = (y_max - y_min + 1) * 12;
-
-    std::vector<double> series(n_months, 0.0);
-    std::vector<int> counts(n_months, 0);
-
+    std::vector<double> t_months, v_months;
     for (auto& kv : monthly_means) {
-      int y = kv.first.first;
-      int m = kv.first.second;
-      double mean = kv.second.mean();
-      int idx = (y - y_min) * 12 + (m - 1);
-      series[idx] += mean;
-      counts[idx] += 1;
+      t_months.push_back(kv.first.first + (kv.first.second - 0.5) / 12.0);
+      v_months.push_back(kv.second.mean());
     }
-    for (int i = 0; i < n_months; ++i) {
-      if (counts[i] > 0)
-        series[i] /= counts[i];
-      else
-        series[i] = 0.0;  // gap → 0
+    const Spectrum ls = lombScargle(t_months, v_months, 4.0, nyquist);
+    if (ls.frequency.empty()) {
+      std::cerr << "Too few months for a frequency analysis.\n";
+      return 0;
     }
 
-    // Detrend (remove mean)
-    double mean_val = 0.0;
-    for (double v : series) mean_val += v;
-    mean_val /= series.size();
-    for (double& v : series) v -= mean_val;
-
-    int N = series.size();
-
-    // FFT
-    TVirtualFFT* fft = TVirtualFFT::FFT(1, &N, "R2C EX K");
-    fft->SetPoints(&series[0]);
-    fft->Transform();
-
-    // Magnitude spectrum
-    int n_freq = N / 2;
-    double nyquist = 12.0 / 2.0;  // cycles per year, Nyquist freq = 6
-    TH1D* h_pow =
-        new TH1D("h_pow", "Frequency Spectrum;Frequency [cycles/year];Power",
-                 n_freq, 0, nyquist);
-
-    double re, im;
-    for (int i = 0; i < n_freq; ++i) {
-      fft->GetPointComplex(i, re, im);
-      double mag2 = re * re + im * im;
-      h_pow->SetBinContent(i + 1, mag2);
-    }
+    // Power spectrum, one bin per frequency
+    const int n_freq = static_cast<int>(ls.frequency.size());
+    const double df = ls.frequency[0];
+    TH1D* h_pow = new TH1D(
+        "h_pow", "Lomb-Scargle Spectrum;Frequency [cycles/year];Power",
+        n_freq, 0.5 * df, (n_freq + 0.5) * df);
+    for (int i = 0; i < n_freq; ++i) h_pow->SetBinContent(i + 1, ls.power[i]);
 
     TCanvas* c3 = new TCanvas("c_freq", "Frequency analysis", 1000, 600);
     gPad->SetLogy();
@@ -397,15 +446,9 @@ int solarMonthlyNorm() {
     TH1D* h_per = new TH1D("h_per", "Periodogram;Period [years];Power", 500,
                            0.5, 50.0);  // fine bins up to 50 yrs
 
-    for (int i = 1; i <= n_freq; ++i) {
-      double f = (i - 1) * 12.0 / N;  // cycles/year
-      if (f > 0) {
-        double T = 1.0 / f;  // years
-        if (T >= 0.5 && T <= 50.0) {
-          double power = h_pow->GetBinContent(i);
-          h_per->Fill(T, power);
-        }
-      }
+    for (int i = 0; i < n_freq; ++i) {
+      double T = 1.0 / ls.frequency[i];  // years
+      if (T >= 0.5 && T <= 50.0) h_per->Fill(T, ls.power[i]);
     }
 
     TCanvas* c4 =
@@ -417,26 +460,110 @@ int solarMonthlyNorm() {
     h_per->Draw("HIST");
     c4->SaveAs("plots/solar/period_analysis.png");
 
+    // ---------- Welch spectrum of the gap-free stretches ----------
+    // Evenly sampled monthly series with NaN for missing months; Welch only
+    // averages the 256-month segments (fewer for a shorter series) without
+    // a gap
+    const int y_min = years_sorted.front();
+    const int n_months = (years_sorted.back() - y_min + 1) * 12;
+    std::vector<double> series(n_months,
+                               std::numeric_limits<double>::quiet_NaN());
+    for (auto& kv : monthly_means)
+      series[monthStep(kv.first.first, kv.first.second, y_min)] =
+          kv.second.mean();
+    const Spectrum welch = welchPeriodogram(series, 12.0, 256);
+    TH1D* h_welch = nullptr;
+    if (!welch.frequency.empty()) {
+      const int n_welch = static_cast<int>(welch.frequency.size());
+      const double dw = welch.frequency[1] - welch.frequency[0];
+      h_welch = new TH1D(
+          "h_welch", "Welch Spectrum;Frequency [cycles/year];PSD [1/cpy]",
+          n_welch, -0.5 * dw, (n_welch - 0.5) * dw);
+      for (int i = 0; i < n_welch; ++i)
+        h_welch->SetBinContent(i + 1, welch.power[i]);
+      TCanvas* c5 = new TCanvas("c_welch", "Welch spectrum", 1000, 600);
+      gPad->SetLogy();
+      h_welch->SetLineColor(kGreen + 2);
+      h_welch->SetLineWidth(2);
+      h_welch->Draw("HIST");
+      c5->SaveAs("plots/solar/solar_welch_spectrum.png");
+    } else {
+      std::cerr << "No gap-free Welch segment, no Welch spectrum.\n";
+    }
+
+    // ---------- Per-station Lomb-Scargle of the hourly rows ----------
+    std::vector<Spectrum> station_spectra(stations.size());
+    parallelFor(stations.size(), threads, [&](std::size_t i) {
+      station_spectra[i] =
+          lombScargle(stations[i].t, stations[i].y, 4.0, nyquist);
+    });
+
+    TCanvas* c6 =
+        new TCanvas("c_station_freq", "Per-station spectra", 1000, 600);
+    gPad->SetLogy();
+    TMultiGraph* mg_st = new TMultiGraph();
+    mg_st->SetTitle(
+        "Lomb-Scargle Spectra of Hourly Rows;Frequency [cycles/year];Power");
+    std::vector<TGraph*> station_graphs;
+    for (std::size_t i = 0; i < stations.size(); ++i) {
+      const Spectrum& sp = station_spectra[i];
+      if (sp.frequency.empty()) continue;
+      TGraph* g = new TGraph(static_cast<int>(sp.frequency.size()),
+                             sp.frequency.data(), sp.power.data());
+      g->SetName(Form("ls_%s", stations[i].name.c_str()));
+      g->SetTitle(stations[i].name.c_str());
+      g->SetLineColor(color_cycle[station_graphs.size() % 12]);
+      mg_st->Add(g, "L");
+      station_graphs.push_back(g);
+    }
+    if (!station_graphs.empty()) {
+      mg_st->Draw("A");
+      mg_st->GetXaxis()->SetLimits(0, 1.0);  // zoom to 0–1 cpy
+      c6->SaveAs("plots/solar/station_frequency_analysis.png");
+    }
+
     TFile* fout3 =
         TFile::Open("datasets/Solar/monthly_norm_temp.root", "UPDATE");
     if (fout3 && !fout3->IsZombie()) {
       h_pow->Write();
       c3->Write("canvas_frequency_analysis");
+      if (h_welch) h_welch->Write();
+      for (TGraph* g : station_graphs) g->Write();
       fout3->Close();
     }
+    std::cout << "Spectra of " << station_graphs.size() << " stations on "
+              << threads << " threads\n";
   }
   return 0;
 }
 
-void plotTempOverTime() {
+int solarMonthlyNorm(unsigned threads = 0) {
+  StageReport report("plot_solar");
+  const int status = solarMonthlyNorm(threads, report);
+  report.write();
+  return status;
+}
+
+int plotTempOverTime() {
   // open the root file
   TFile* f = TFile::Open("datasets/Solar/adjusted_temps.root");
+  if (!f || f->IsZombie()) {
+    std::cerr << "ERROR: Cannot open datasets/Solar/adjusted_temps.root\n";
+    return 1;
+  }
   TTree* t = (TTree*)f->Get("temps");  // adjust to your TTree name
+  if (!t) {
+    std::cerr << "ERROR: Could not find TTree 'temps' in file.\n";
+    return 1;
+  }
 
   // variables for branches
   int year, month, day;
   double temp;
 
+  t->SetBranchStatus("*", false);
+  for (const char* name : {"year", "month", "day", "temp_adj_C"})
+    t->SetBranchStatus(name, true);
   t->SetBranchAddress("year", &year);
   t->SetBranchAddress("month", &month);
   t->SetBranchAddress("day", &day);
@@ -459,9 +586,18 @@ void plotTempOverTime() {
   gr->SetMarkerStyle(20);
   gr->SaveAs("plots/solar/TempOverTime.png");
   gr->Draw("AP");
+  return 0;
 }
 
-void plot_solar() {
-  plotTempOverTime();
-  solarMonthlyNorm();
+// 0, or 1 if a plot could not be made
+int plot_solar(unsigned threads = 0) {
+  StageReport report("plot_solar");
+  int status = 0;
+  {
+    ScopedPhase phase(report, "timeline");
+    status = plotTempOverTime();
+  }
+  if (status == 0) status = solarMonthlyNorm(threads, report);
+  report.write();
+  return status;
 }
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "filter.h"
+#include "station_cache.h"
+
+// Usage:
+// g++ -O2 -Iinclude src/query.cxx src/filter.cxx -o build/query
+// ./build/query [City ...] --where EXPR [--rows] [--cache-dir DIR]
+//
+// Runs a filter expression (see filter.h) over the columnar station caches
+// written by build/clean (default datasets/cache, every station if no city
+// is given), e.g. summers since 1990 in Lund:
+//   ./build/query Lund --where "year=1990-2024 month=6-8"
+// Prints one line per station with the zone map blocks read out of the
+// total, the matching rows and their mean, min and max temperature, and a
+// total over the stations. --rows prints the matching rows instead, as
+// "station;year;month;day;hour;temperature;quality".
+
+namespace fs = std::filesystem;
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> cities;
+  fs::path cache_dir = "datasets/cache";
+  Filter where;
+  std::string error;
+  bool print_rows = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--where" && i + 1 < argc) {
+      if (!where.compile(argv[++i], error)) {
+        std::cerr << "--where: " << error << "\n";
+        return 1;
+      }
+    } else if (arg == "--rows") {
+      print_rows = true;
+    } else if (arg == "--cache-dir" && i + 1 < argc) {
+      cache_dir = argv[++i];
+    } else if (!arg.empty() && arg[0] == '-') {
+      std::cerr << "Usage: " << argv[0]
+                << " [City ...] --where EXPR [--rows] [--cache-dir DIR]"
+                << std::endl;
+      return 1;
+    } else {
+      cities.push_back(fs::path(arg).stem().string());
+    }
+  }
+
+  if (cities.empty()) {
+    if (!fs::is_directory(cache_dir)) {
+      std::cerr << "Cache directory not found: " << cache_dir << "\n";
+      return 1;
+    }
+    for (const auto& entry : fs::directory_iterator(cache_dir))
+      if (entry.path().extension() == ".col")
+        cities.push_back(entry.path().stem().string());
+    std::sort(cities.begin(), cities.end());
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::size_t total_blocks = 0, read_blocks = 0, total_rows = 0, matched = 0;
+  std::vector<std::uint32_t> selection;
+  int failed = 0;
+  if (!print_rows)
+    std::cout << "station;blocks_read;blocks;rows_matched;mean;min;max\n";
+
+  for (const std::string& city : cities) {
+    if (!where.matchesStation(city)) continue;
+    StationCache cache(stationCachePath(cache_dir.string(), city));
+    if (!cache.is_open()) {
+      std::cerr << cache.error() << "\n";
+      ++failed;
+      continue;
+    }
+    const StationView& v = cache.view();
+    selection.clear();
+    where.select(v, selection);
+    const std::size_t blocks = where.candidateBlocks(v);
+    total_blocks += v.blocks();
+    read_blocks += blocks;
+    total_rows += v.rows;
+    matched += selection.size();
+
+    if (print_rows) {
+      for (std::uint32_t i : selection)
+        std::cout << city << ";" << v.year[i] << ";" << int(v.month[i]) << ";"
+                  << int(v.day[i]) << ";" << int(v.hour[i]) << ";"
+                  << v.temperature[i] << ";" << v.quality[i] << "\n";
+      continue;
+    }
+    double sum = 0;
+    float lo = 0, hi = 0;
+    for (std::size_t j = 0; j < selection.size(); ++j) {
+      const float t = v.temperature[selection[j]];
+      sum += t;
+      lo = j == 0 ? t : std::min(lo, t);
+      hi = j == 0 ? t : std::max(hi, t);
+    }
+    std::cout << city << ";" << blocks << ";" << v.blocks() << ";"
+              << selection.size() << ";";
+    if (selection.empty())
+      std::cout << ";;\n";
+    else
+      std::cout << sum / selection.size() << ";" << lo << ";" << hi << "\n";
+  }
+
+  std::chrono::duration<double> s = std::chrono::steady_clock::now() - start;
+  std::cerr << matched << " of " << total_rows << " rows match, "
+            << read_blocks << " of " << total_blocks << " blocks read ("
+            << (total_blocks ? 100.0 * read_blocks / total_blocks : 0.0)
+            << "%) in " << s.count() << " s\n";
+  return failed == 0 ? 0 : 1;
+}
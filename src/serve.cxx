@@ -0,0 +1,605 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "b-days.h"
+#include "climate.h"
+#include "filter.h"
+#include "parallel.h"
+#include "parse_utils.h"
+#include "solar.h"
+#include "station_cache.h"
+#include "station_store.h"
+#include "trend.h"
+
+// Usage (commands of build/pipeline, see main.cxx):
+// ./build/pipeline serve [--socket PATH] [--cache-dir DIR] [-j N]
+// ./build/pipeline ask [--socket PATH] [REQUEST ...]
+//
+// serve loads every station cache in datasets/cache into memory once (see
+// station_store.h) and answers requests on the Unix socket PATH (default
+// datasets/serve.sock) until SIGINT or SIGTERM, which close the open
+// connections. Every connection gets its own thread and may send any
+// number of requests. A request is one line;
+// the answer is "OK N" followed by N lines, or a single "ERR message" line.
+//
+//   PING
+//   STATIONS      station;latitude;longitude;rows;first_year;last_year
+//   AGG CITY year|month|day [FILTER ...]
+//                 year[;month[;day]];max;min;mean per period of the quality
+//                 G rows passing the filter (filter.h), as build/climate,
+//                 e.g. "AGG Lund month year=1990-2024 month=6-8"
+//   TREND CITY [mean|max|min] [FROM TO]
+//                 slope;slope_error;intercept;intercept_error;points of the
+//                 yearly values, slopes in degrees per century. Without a
+//                 range the years are binned as in the trend plots and
+//                 datasets/trends.csv. With one, every year FROM-TO is a
+//                 point of equal weight, the errors coming from the
+//                 scatter of the years around the line
+//   BDAY CITY MM-DD[,MM-DD ...] [HOURS]
+//                 year;month;day;avg as build/b-days, HOURS default 10-15
+//   SOLAR CITY [FROM TO]
+//                 year;rows;mean_raw;mean_adjusted of the quality G rows
+//                 between 11 and 15 UTC, adjusted as in solar.cxx
+//   QUIT          closes the connection
+//
+// ask sends its REQUEST words as one line and prints the answer lines, or,
+// without a request, sends every line of its standard input:
+//   ./build/pipeline ask TREND Lund mean 1950 2024
+// Any client that speaks lines works as well, e.g.
+//   socat - UNIX-CONNECT:datasets/serve.sock
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const kDefaultSocket = "datasets/serve.sock";
+// Longest request line accepted before the connection is dropped
+constexpr std::size_t kMaxRequest = 1 << 16;
+
+struct Answer {
+  std::vector<std::string> lines;
+  std::string error;
+  bool quit = false;
+};
+
+std::vector<std::string_view> splitWords(std::string_view line) {
+  std::vector<std::string_view> words;
+  while (!(line = trim(line, " \t")).empty()) {
+    std::size_t end = line.find_first_of(" \t");
+    if (end == std::string_view::npos) end = line.size();
+    words.push_back(line.substr(0, end));
+    line.remove_prefix(end);
+  }
+  return words;
+}
+
+std::shared_ptr<const StoredStation> findStation(std::string_view name,
+                                                 Answer& answer) {
+  auto station = StationStore::instance().find(std::string(name));
+  if (!station) answer.error = "unknown station " + std::string(name);
+  return station;
+}
+
+// Optional "FROM TO" at w[i], w[i + 1]
+bool yearRange(const std::vector<std::string_view>& w, std::size_t i,
+               int& from, int& to, Answer& answer) {
+  if (w.size() == i) return true;
+  if (w.size() != i + 2 || !parseInt(w[i], from) || !parseInt(w[i + 1], to) ||
+      from > to) {
+    answer.error = "expected FROM TO years";
+    return false;
+  }
+  return true;
+}
+
+// Rows of `station` passing `expr`, zone map blocks that cannot match skipped
+bool selectRows(const StoredStation& station, const std::string& expr,
+                std::vector<std::uint32_t>& rows, Answer& answer) {
+  Filter filter;
+  if (!filter.compile(expr, answer.error)) return false;
+  filter.select(station.view(), rows);
+  return true;
+}
+
+template <typename... T>
+std::string joinFields(const T&... fields) {
+  std::ostringstream line;
+  const char* separator = "";
+  ((line << separator << fields, separator = ";"), ...);
+  return line.str();
+}
+
+void stations(Answer& answer) {
+  for (const std::string& name : StationStore::instance().names()) {
+    auto station = StationStore::instance().find(name);
+    const StationColumns& c = station->columns;
+    int first = 0, last = 0;
+    if (c.size() > 0) {
+      const auto [lo, hi] = std::minmax_element(c.year.begin(), c.year.end());
+      first = *lo;
+      last = *hi;
+    }
+    answer.lines.push_back(joinFields(name, c.latitude, c.longitude, c.size(),
+                                      first, last));
+  }
+}
+
+void aggregate(const std::vector<std::string_view>& w, Answer& answer) {
+  const int depth = w.size() < 3      ? 0
+                    : w[2] == "year"  ? 1
+                    : w[2] == "month" ? 2
+                    : w[2] == "day"   ? 3
+                                      : 0;
+  if (depth == 0) {
+    answer.error = "usage: AGG CITY year|month|day [FILTER ...]";
+    return;
+  }
+  auto station = findStation(w[1], answer);
+  if (!station) return;
+  std::string expr = "quality=G";
+  for (std::size_t i = 3; i < w.size(); ++i) expr += " " + std::string(w[i]);
+  std::vector<std::uint32_t> rows;
+  if (!selectRows(*station, expr, rows, answer)) return;
+
+  const StationView v = station->view();
+  std::map<std::array<int, 3>, Accumulator> periods;
+  for (std::uint32_t i : rows)
+    periods[{v.year[i], depth > 1 ? v.month[i] : 0, depth > 2 ? v.day[i] : 0}]
+        .add(v.temperature[i]);
+  for (const auto& [key, acc] : periods) {
+    std::ostringstream line;
+    for (int d = 0; d < depth; ++d) line << key[d] << ";";
+    line << acc.max << ";" << acc.min << ";" << acc.sum / acc.count;
+    answer.lines.push_back(line.str());
+  }
+}
+
+void trend(const std::vector<std::string_view>& w, Answer& answer) {
+  if (w.size() < 2) {
+    answer.error = "usage: TREND CITY [mean|max|min] [FROM TO]";
+    return;
+  }
+  std::size_t next = 2;
+  std::string_view metric = "mean";
+  if (w.size() > 2 && (w[2] == "mean" || w[2] == "max" || w[2] == "min"))
+    metric = w[next++];
+  int from = 0, to = 0;
+  if (!yearRange(w, next, from, to, answer)) return;
+  const bool ranged = w.size() > next;
+  auto station = findStation(w[1], answer);
+  if (!station) return;
+
+  std::string expr = "quality=G";
+  if (ranged)
+    expr += " year=" + std::to_string(from) + "-" + std::to_string(to);
+  std::vector<std::uint32_t> rows;
+  if (!selectRows(*station, expr, rows, answer)) return;
+  const StationView v = station->view();
+  std::map<int, Accumulator> years;
+  for (std::uint32_t i : rows) years[v.year[i]].add(v.temperature[i]);
+
+  auto value = [&](const Accumulator& acc) {
+    return metric == "max" ? acc.max
+           : metric == "min" ? acc.min
+                             : acc.sum / acc.count;
+  };
+  TrendFit fit;
+  if (ranged) {
+    // A yearly value has no usable error of its own: the hourly values of a
+    // year are strongly autocorrelated, so the standard error of their mean
+    // is far too small. The errors come from the scatter of the years
+    // around the line.
+    TrendAccumulator acc;
+    for (const auto& [year, a] : years) acc.add(year, value(a), 1.0);
+    fit = acc.fitToScatter();
+  } else {
+    YearProfile profile;
+    for (const auto& [year, a] : years) profile.add(year, value(a));
+    fit = profile.fit();
+  }
+  if (!fit.ok) {
+    answer.error = "too few years for a trend";
+    return;
+  }
+  answer.lines.push_back(joinFields(100 * fit.slope, 100 * fit.slope_error,
+                                    fit.intercept, fit.intercept_error,
+                                    fit.points));
+}
+
+void birthdays(const std::vector<std::string_view>& w, Answer& answer) {
+  if (w.size() < 3 || w.size() > 4) {
+    answer.error = "usage: BDAY CITY MM-DD[,MM-DD ...] [HOURS]";
+    return;
+  }
+  auto station = findStation(w[1], answer);
+  if (!station) return;
+  Filter filter;
+  const std::string expr = "date=" + std::string(w[2]) + " hour=" +
+                           std::string(w.size() > 3 ? w[3] : "10-15") +
+                           " quality=G";
+  if (!filter.compile(expr, answer.error)) return;
+  BirthdayAverages averages(filter);
+  averages.add(station->view());
+  averages.forEachAverage([&](int year, int month, int day, double average) {
+    answer.lines.push_back(joinFields(year, month, day, average));
+  });
+}
+
+void solarAdjusted(const std::vector<std::string_view>& w, Answer& answer) {
+  if (w.size() < 2) {
+    answer.error = "usage: SOLAR CITY [FROM TO]";
+    return;
+  }
+  int from = 0, to = 0;
+  if (!yearRange(w, 2, from, to, answer)) return;
+  auto station = findStation(w[1], answer);
+  if (!station) return;
+
+  std::string expr = kSolarRowFilter;
+  if (w.size() > 2)
+    expr += " year=" + std::to_string(from) + "-" + std::to_string(to);
+  std::vector<std::uint32_t> rows;
+  if (!selectRows(*station, expr, rows, answer)) return;
+  const StationView v = station->view();
+  const IrradianceTable table(v.longitude, v.latitude);
+  struct Year {
+    long rows = 0;
+    double raw = 0, adjusted = 0;
+  };
+  std::map<int, Year> years;
+  for (std::uint32_t i : rows) {
+    const double G0h = table.irradiance(v.year[i], v.month[i], v.day[i],
+                                        v.hour[i]);
+    const double correction =
+        kSolarBeta * (G0h - table.mean(v.year[i], v.hour[i]));
+    Year& y = years[v.year[i]];
+    ++y.rows;
+    y.raw += v.temperature[i];
+    y.adjusted += v.temperature[i] - correction;
+  }
+  for (const auto& [year, y] : years)
+    answer.lines.push_back(
+        joinFields(year, y.rows, y.raw / y.rows, y.adjusted / y.rows));
+}
+
+Answer answerRequest(std::string_view line) {
+  Answer answer;
+  const std::vector<std::string_view> w = splitWords(line);
+  if (w.empty()) {
+    answer.error = "empty request";
+    return answer;
+  }
+  std::string command(w[0]);
+  std::transform(command.begin(), command.end(), command.begin(),
+                 [](unsigned char c) { return std::toupper(c); });
+  if (command == "PING") {
+  } else if (command == "STATIONS") {
+    stations(answer);
+  } else if (command == "AGG") {
+    aggregate(w, answer);
+  } else if (command == "TREND") {
+    trend(w, answer);
+  } else if (command == "BDAY") {
+    birthdays(w, answer);
+  } else if (command == "SOLAR") {
+    solarAdjusted(w, answer);
+  } else if (command == "QUIT") {
+    answer.quit = true;
+  } else {
+    answer.error = "unknown request " + command;
+  }
+  return answer;
+}
+
+bool writeAll(int fd, const std::string& text) {
+  std::size_t done = 0;
+  while (done < text.size()) {
+    const ssize_t n = ::write(fd, text.data() + done, text.size() - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    done += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+// Reads one line into `line`, keeping what follows it in `buffer`. False at
+// the end of the input or on an error.
+bool readLine(int fd, std::string& buffer, std::string& line) {
+  std::size_t newline;
+  char chunk[4096];
+  while ((newline = buffer.find('\n')) == std::string::npos) {
+    if (buffer.size() > kMaxRequest) return false;
+    const ssize_t n = ::read(fd, chunk, sizeof chunk);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    buffer.append(chunk, static_cast<std::size_t>(n));
+  }
+  line.assign(buffer, 0, newline);
+  buffer.erase(0, newline + 1);
+  if (!line.empty() && line.back() == '\r') line.pop_back();
+  return true;
+}
+
+// The connections being served. On shutdown the server closes them and
+// waits for their threads, which read the station store, before it
+// returns and the store goes away.
+class Clients {
+ private:
+  std::mutex m_mutex;
+  std::condition_variable m_done;
+  std::set<int> m_fds;
+
+ public:
+  void add(int fd) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fds.insert(fd);
+  }
+
+  // Closes fd, under the lock so that closeAll() never sees a reused one
+  void remove(int fd) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fds.erase(fd);
+    ::close(fd);
+    m_done.notify_all();
+  }
+
+  // Ends every connection; the blocked reads return and the threads finish
+  void closeAll() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int fd : m_fds) ::shutdown(fd, SHUT_RDWR);
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_fds.empty(); });
+  }
+};
+
+void serveClient(int fd, Clients& clients) {
+  std::string buffer, line;
+  while (readLine(fd, buffer, line)) {
+    const Answer answer = answerRequest(line);
+    std::string text;
+    if (!answer.error.empty()) {
+      text = "ERR " + answer.error + "\n";
+    } else {
+      text = "OK " + std::to_string(answer.lines.size()) + "\n";
+      for (const std::string& l : answer.lines) text += l + "\n";
+    }
+    if (!writeAll(fd, text) || answer.quit) break;
+  }
+  clients.remove(fd);
+}
+
+StationColumns copyColumns(const StationView& v) {
+  StationColumns c;
+  c.name = std::string(v.name);
+  c.latitude = v.latitude;
+  c.longitude = v.longitude;
+  c.year.assign(v.year, v.year + v.rows);
+  c.month.assign(v.month, v.month + v.rows);
+  c.day.assign(v.day, v.day + v.rows);
+  c.hour.assign(v.hour, v.hour + v.rows);
+  c.temperature.assign(v.temperature, v.temperature + v.rows);
+  c.quality.assign(v.quality, v.quality + v.rows);
+  return c;
+}
+
+bool connectTo(const std::string& path, int& fd) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof address.sun_path) return false;
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path.c_str(), sizeof address.sun_path - 1);
+  fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof address) ==
+      0)
+    return true;
+  ::close(fd);
+  return false;
+}
+
+}  // namespace
+
+int serveMain(int argc, char* argv[]) {
+  std::string socket_path = kDefaultSocket;
+  fs::path cache_dir = "datasets/cache";
+  unsigned threads = defaultThreads();
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--socket" && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (arg == "--cache-dir" && i + 1 < argc) {
+      cache_dir = argv[++i];
+    } else if (arg == "-j" && i + 1 < argc) {
+      threads = parseThreads(argv[++i]);
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--socket PATH] [--cache-dir DIR] [-j N]" << std::endl;
+      return 1;
+    }
+  }
+
+  // SIGINT and SIGTERM are blocked before any thread starts, so every
+  // thread inherits the mask and the signals only arrive through the
+  // signalfd the accept loop polls
+  sigset_t stop_signals, old_mask;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+  std::signal(SIGPIPE, SIG_IGN);
+  auto restoreSignals = [&] {
+    pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+  };
+
+  // Every station into memory, in parallel
+  auto start = std::chrono::steady_clock::now();
+  std::vector<fs::path> files;
+  if (fs::is_directory(cache_dir))
+    for (const auto& entry : fs::directory_iterator(cache_dir))
+      if (entry.path().extension() == ".col") files.push_back(entry.path());
+  if (files.empty()) {
+    std::cerr << "No station caches in " << cache_dir
+              << ", run build/clean first" << std::endl;
+    restoreSignals();
+    return 1;
+  }
+  StationStore& store = StationStore::instance();
+  store.enable();
+  std::vector<std::size_t> rows(files.size());
+  parallelFor(files.size(), threads, [&](std::size_t i) {
+    StationCache cache(files[i].string());
+    if (!cache.is_open()) {
+      std::cerr << cache.error() + "\n";
+      return;
+    }
+    rows[i] = cache.view().rows;
+    store.put(copyColumns(cache.view()));
+  });
+  std::size_t total = 0;
+  for (std::size_t r : rows) total += r;
+  std::chrono::duration<double> s = std::chrono::steady_clock::now() - start;
+  std::cout << "Loaded " << store.names().size() << " stations, " << total
+            << " rows in " << s.count() << " s" << std::endl;
+
+  sockaddr_un address{};
+  if (socket_path.size() >= sizeof address.sun_path) {
+    std::cerr << "Socket path too long: " << socket_path << std::endl;
+    restoreSignals();
+    return 1;
+  }
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, socket_path.c_str(),
+               sizeof address.sun_path - 1);
+  const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ::unlink(socket_path.c_str());
+  const int signals = ::signalfd(-1, &stop_signals, SFD_CLOEXEC);
+  if (listener < 0 ||
+      ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address) !=
+          0 ||
+      ::listen(listener, 16) != 0 || signals < 0) {
+    std::cerr << "Cannot listen on " << socket_path << ": "
+              << std::strerror(errno) << std::endl;
+    if (listener >= 0) ::close(listener);
+    if (signals >= 0) ::close(signals);
+    restoreSignals();
+    return 1;
+  }
+
+  std::cout << "Listening on " << socket_path << std::endl;
+  Clients clients;
+  pollfd fds[2] = {{listener, POLLIN, 0}, {signals, POLLIN, 0}};
+  while (true) {
+    if (::poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      std::cerr << "poll: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    if (fds[1].revents) {
+      signalfd_siginfo info;
+      if (::read(signals, &info, sizeof info) == sizeof info) break;
+    }
+    if (!(fds[0].revents & POLLIN)) continue;
+    const int client = ::accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      std::cerr << "accept: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    clients.add(client);
+    std::thread(serveClient, client, std::ref(clients)).detach();
+  }
+  ::close(listener);
+  ::close(signals);
+  ::unlink(socket_path.c_str());
+  // No thread may still read the store when this returns
+  clients.closeAll();
+  clients.wait();
+  restoreSignals();
+  std::cout << "Stopped" << std::endl;
+  return 0;
+}
+
+int askMain(int argc, char* argv[]) {
+  std::string socket_path = kDefaultSocket;
+  std::string request;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--socket" && i + 1 < argc && request.empty()) {
+      socket_path = argv[++i];
+    } else {
+      request += (request.empty() ? "" : " ") + arg;
+    }
+  }
+
+  int fd;
+  if (!connectTo(socket_path, fd)) {
+    std::cerr << "Cannot connect to " << socket_path
+              << ", is build/pipeline serve running?" << std::endl;
+    return 1;
+  }
+  std::signal(SIGPIPE, SIG_IGN);
+
+  int status = 0;
+  std::string buffer, line;
+  auto ask = [&](const std::string& text) {
+    auto start = std::chrono::steady_clock::now();
+    if (!writeAll(fd, text + "\n") || !readLine(fd, buffer, line)) {
+      std::cerr << "Connection lost" << std::endl;
+      return false;
+    }
+    if (line.compare(0, 3, "OK ") != 0) {
+      std::cerr << line << std::endl;
+      status = 1;
+      return true;
+    }
+    const long n = std::stol(line.substr(3));
+    for (long i = 0; i < n && readLine(fd, buffer, line); ++i)
+      std::cout << line << "\n";
+    std::chrono::duration<double, std::milli> ms =
+        std::chrono::steady_clock::now() - start;
+    std::cout.flush();
+    std::cerr << n << " lines in " << ms.count() << " ms" << std::endl;
+    return true;
+  };
+
+  if (!request.empty()) {
+    if (!ask(request)) status = 1;
+  } else {
+    std::string input;
+    while (std::getline(std::cin, input))
+      if (!input.empty() && !ask(input)) {
+        status = 1;
+        break;
+      }
+  }
+  ::close(fd);
+  return status;
+}
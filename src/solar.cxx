@@ -1,231 +1,316 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <sstream>
-#include <stdexcept>
+#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "TFile.h"
 #include "TTree.h"
+#include "filter.h"
+#include "instrument.h"
+#include "parallel.h"
+#include "solar.h"
+#include "station_cache.h"
+#include "station_store.h"
 
 #ifdef year
 #undef year
 #endif
 
-namespace fs = std::filesystem;
-
-// ------------------ Solar math (UTC, on-the-hour) ------------------
-constexpr double PI = 3.14159265358979323846;
-constexpr double DEG2RAD = PI / 180.0;
-constexpr double I_sc = 1367.0;  // W/m^2 (solar constant)
-
-inline bool isLeap(int year) {
-  return (year % 400 == 0) || (year % 4 == 0 && year % 100 != 0);
-}
-
-inline int dayOfYear(int y, int m, int d) {
-  static const int cum[12] = {0,   31,  59,  90,  120, 151,
-                              181, 212, 243, 273, 304, 334};
-  int maxd = (m == 2 ? (isLeap(y) ? 29 : 28)
-                     : (m == 4 || m == 6 || m == 9 || m == 11 ? 30 : 31));
-  if (m < 1 || m > 12 || d < 1 || d > maxd) return -1;
-  int J = cum[m - 1] + d;
-  if (m > 2 && isLeap(y)) ++J;
-  return J;
-}
-
-inline double equationOfTime_min(int J) {
-  double B = 2.0 * PI * (J - 81) / 364.0;
-  return 9.87 * std::sin(2.0 * B) - 7.53 * std::cos(B) - 1.5 * std::sin(B);
-}
-inline double solarDeclination_rad(int J) {
-  return 23.45 * DEG2RAD * std::sin(2.0 * PI * (284.0 + J) / 365.0);
-}
-inline double eccentricityCorr(int J) {
-  return 1.0 + 0.033 * std::cos(2.0 * PI * J / 365.0);
-}
-inline double cosZenith(double lat_rad, double decl_rad,
-                        double hour_angle_rad) {
-  return std::sin(lat_rad) * std::sin(decl_rad) +
-         std::cos(lat_rad) * std::cos(decl_rad) * std::cos(hour_angle_rad);
-}
+// ACLiC (bash/solar_analysis.sh) builds this file on its own, without
+// the filter, so it compiles the filter in
+#ifdef __ACLIC__
+#include "filter.cxx"
+#endif
 
-// Instantaneous TOA horizontal irradiance [W/m^2]
-// Inputs: UTC hour (integer hour), lon/lat in degrees (east+/north+)
-inline double toaHorizontalIrradiance_Wm2(int year, int month, int day,
-                                          int hourUTC, double lon_deg,
-                                          double lat_deg) {
-  int J = dayOfYear(year, month, day);
-  if (J < 1) return 0.0;
-
-  const double EoT = equationOfTime_min(J);
-  const double lst =
-      hourUTC + (lon_deg * 4.0 + EoT) / 60.0;        // local solar time [h]
-  const double H = (15.0 * (lst - 12.0)) * DEG2RAD;  // hour angle [rad]
-
-  const double delta = solarDeclination_rad(J);
-  const double lat = lat_deg * DEG2RAD;
-  const double mu0 = cosZenith(lat, delta, H);
-  if (mu0 <= 0.0) return 0.0;
-
-  const double E0 = eccentricityCorr(J);
-  return I_sc * E0 * mu0;
-}
+namespace fs = std::filesystem;
 
-// Mean TOA horizontal irradiance at same UTC hour across the year [W/m^2]
-inline double meanToaIrradiance_Wm2_sameHour(int year, int hourUTC,
-                                             double lon_deg, double lat_deg) {
-  const int days = isLeap(year) ? 366 : 365;
-  const double lat = lat_deg * DEG2RAD;
-  double sum = 0.0;
-  for (int J = 1; J <= days; ++J) {
-    const double EoT = equationOfTime_min(J);
-    const double lst = hourUTC + (lon_deg * 4.0 + EoT) / 60.0;
-    const double H = (15.0 * (lst - 12.0)) * DEG2RAD;
-    const double delta = solarDeclination_rad(J);
-    const double mu0 = cosZenith(lat, delta, H);
-    const double E0 = eccentricityCorr(J);
-    const double G0h = (mu0 > 0.0) ? (I_sc * E0 * mu0) : 0.0;
-    sum += G0h;
+// ------------------ Per-station adjustment ------------------
+
+// Beta (°C per W/m^2), see solar.h
+constexpr double beta = kSolarBeta;
+
+// One entry of the output tree
+struct AdjustedRow {
+  int year, month, day, hour;
+  double lat, lon, temp_raw, G0h, G0h_mean, correction, temp_adj;
+};
+
+// Everything one station contributes, computed on a worker thread and
+// written to the tree afterwards on the main thread
+struct StationRows {
+  std::vector<AdjustedRow> rows;
+  std::size_t lines = 0, bad_lines = 0;
+  std::string error;  // non-empty if the station could not be read
+};
+
+class StationAdjuster {
+ private:
+  StationRows& m_out;
+  // Irradiances only depend on the station position, the day of year and
+  // the hour, so they are tabulated once per station and looked up per row
+  std::unique_ptr<IrradianceTable> m_irradiance;
+
+ public:
+  explicit StationAdjuster(StationRows& out) : m_out{out} {}
+
+  void add(int year, int month, int day, int hour, double tempC, double lat,
+           double lon) {
+    if (!m_irradiance || !m_irradiance->isFor(lon, lat))
+      m_irradiance = std::make_unique<IrradianceTable>(lon, lat);
+
+    // Compute irradiances
+    double G0h = m_irradiance->irradiance(year, month, day, hour);
+    double G0h_mean = m_irradiance->mean(year, hour);
+
+    // Correction and adjusted T
+    double correction = beta * (G0h - G0h_mean);
+    double T_adj = tempC - correction;
+
+    m_out.rows.push_back({year, month, day, hour, lat, lon, tempC, G0h,
+                          G0h_mean, correction, T_adj});
+  }
+};
+
+// The rows of the columnar cache passing `filter`, kSolarRowFilter. In
+// build/pipeline the columns the clean stage kept in memory are used.
+static void adjustCachedStation(const fs::path& file, const Filter& filter,
+                                StationRows& out) {
+  const auto stored = StationStore::instance().find(file.stem().string());
+  StationCache cache;
+  if (!stored) cache = StationCache(file.string());
+  if (!stored && !cache.is_open()) {
+    out.error = cache.error();
+    return;
+  }
+  const StationView v = stored ? stored->view() : cache.view();
+  std::vector<std::uint32_t> rows;
+  filter.select(v, rows);
+  StationAdjuster adjuster(out);
+  for (std::uint32_t i : rows) {
+    ++out.lines;
+    adjuster.add(v.year[i], v.month[i], v.day[i], v.hour[i], v.temperature[i],
+                 v.latitude, v.longitude);
   }
-  return sum / days;
 }
 
-// ------------------ Parsing utils ------------------
-static inline bool parseLine(const std::string& line, int& year, int& month,
-                             int& day, int& hour, double& tempC, double& lat,
-                             double& lon) {
-  // Format: year;month;day;hour;temperature;latitude;longitude
-  // Example: 1944;07;09;13;30.6;59.9000;17.5930
-  std::stringstream ss(line);
-  std::string tok;
-  std::vector<std::string> tokens;
-  while (std::getline(ss, tok, ';')) tokens.push_back(tok);
-  if (tokens.size() != 7) return false;
-
-  try {
-    year = std::stoi(tokens[0]);
-    month = std::stoi(tokens[1]);
-    day = std::stoi(tokens[2]);
-    hour = std::stoi(tokens[3]);
-    tempC = std::stod(tokens[4]);
-    lat = std::stod(tokens[5]);
-    lon = std::stod(tokens[6]);
-    return true;
-  } catch (...) {
-    return false;
+// Every row of a Solar/ text file, which only holds the hour window already
+static void adjustTextStation(const fs::path& file, StationRows& out) {
+  std::ifstream fin(file);
+  if (!fin) {
+    out.error = "Could not open: " + file.string();
+    return;
+  }
+  StationAdjuster adjuster(out);
+  std::string line;
+  while (std::getline(fin, line)) {
+    ++out.lines;
+    if (line.empty()) continue;
+
+    int year{0}, month{0}, day{0}, hour{0};
+    double tempC{0.0}, lat{0.0}, lon{0.0};
+    if (!parseSolarLine(line, year, month, day, hour, tempC, lat, lon)) {
+      ++out.bad_lines;
+      continue;
+    }
+    adjuster.add(year, month, day, hour, tempC, lat, lon);
   }
 }
 
 // ------------------ Main ------------------
-void adjustTemps() {
+
+// threads = 0 uses every core. Stations are adjusted in parallel, a window
+// of them at a time, and their rows are appended to the tree in sorted file
+// order, so the output does not depend on the thread count. Returns 0, or 1
+// if there was no input or output or a station could not be read.
+int adjustTemps(unsigned threads = 0) {
   std::ios::sync_with_stdio(false);
+  if (threads == 0) threads = defaultThreads();
+  StageReport report("solar");
 
-  // Inputs
+  // Inputs. The columnar cache written by build/clean is used when present,
+  // otherwise the Solar/ text subset.
   fs::path in_dir = fs::path("datasets/Solar");
+  fs::path cache_dir = fs::path("datasets/cache");
   fs::path out_file = fs::path("datasets/Solar/adjusted_temps.root");
 
+  Filter filter;
+  std::string error;
+  if (!filter.compile(kSolarRowFilter, error)) {
+    std::cerr << "Bad solar row filter: " << error << "\n";
+    return 1;
+  }
+
+  if (!fs::is_directory(in_dir) && !fs::is_directory(cache_dir)) {
+    std::cerr << "Input directory not found: " << in_dir << "\n";
+    return 1;
+  }
+
+  std::vector<fs::path> files;
+  if (fs::is_directory(cache_dir))
+    for (auto const& dirent : fs::directory_iterator(cache_dir))
+      if (dirent.path().extension() == ".col") files.push_back(dirent.path());
+  const bool use_cache = !files.empty();
+  // Text fallback, only read when there was no cache
+  if (!use_cache && fs::is_directory(in_dir))
+    for (auto const& dirent : fs::directory_iterator(in_dir))
+      if (dirent.is_regular_file() && dirent.path().extension() == ".csv")
+        files.push_back(dirent.path());
+  std::sort(files.begin(), files.end());
+
   // ROOT output
   TFile* fout = TFile::Open(out_file.string().c_str(), "RECREATE");
   if (!fout || fout->IsZombie()) {
     std::cerr << "Failed to create ROOT file: " << out_file << "\n";
-    return;
+    return 1;
   }
   TTree* tree = new TTree("temps", "Solar-adjusted temperatures");
 
   // Branch variables
-  int b_year, b_month, b_day, b_hour;
-  double b_lat, b_lon, b_temp_raw, b_G0h, b_G0h_mean, b_correction, b_temp_adj;
-
-  tree->Branch("year", &b_year, "year/I");
-  tree->Branch("month", &b_month, "month/I");
-  tree->Branch("day", &b_day, "day/I");
-  tree->Branch("hour_utc", &b_hour, "hour_utc/I");
-  tree->Branch("lat_deg", &b_lat, "lat_deg/D");
-  tree->Branch("lon_deg", &b_lon, "lon_deg/D");
-  tree->Branch("temp_raw_C", &b_temp_raw, "temp_raw_C/D");
-  tree->Branch("G0h_Wm2", &b_G0h, "G0h_Wm2/D");
-  tree->Branch("G0h_mean_Wm2", &b_G0h_mean, "G0h_mean_Wm2/D");
-  tree->Branch("correction_C", &b_correction, "correction_C/D");
-  tree->Branch("temp_adj_C", &b_temp_adj, "temp_adj_C/D");
-
-  // Beta (°C per W/m^2). Adjust if you’ve fitted a slope.
-  const double beta = 0.003;
+  AdjustedRow b;
+
+  tree->Branch("year", &b.year, "year/I");
+  tree->Branch("month", &b.month, "month/I");
+  tree->Branch("day", &b.day, "day/I");
+  tree->Branch("hour_utc", &b.hour, "hour_utc/I");
+  tree->Branch("lat_deg", &b.lat, "lat_deg/D");
+  tree->Branch("lon_deg", &b.lon, "lon_deg/D");
+  tree->Branch("temp_raw_C", &b.temp_raw, "temp_raw_C/D");
+  tree->Branch("G0h_Wm2", &b.G0h, "G0h_Wm2/D");
+  tree->Branch("G0h_mean_Wm2", &b.G0h_mean, "G0h_mean_Wm2/D");
+  tree->Branch("correction_C", &b.correction, "correction_C/D");
+  tree->Branch("temp_adj_C", &b.temp_adj, "temp_adj_C/D");
+  // Index into the "stations" tree written below
+  int b_station;
+  tree->Branch("station", &b_station, "station/I");
+  std::vector<std::string> station_names;
 
   std::size_t total_lines = 0, bad_lines = 0, files_processed = 0;
-
-  // Iterate files
-  if (!fs::exists(in_dir) || !fs::is_directory(in_dir)) {
-    std::cerr << "Input directory not found: " << in_dir << "\n";
-    return;
-  }
-
-  for (auto const& dirent : fs::directory_iterator(in_dir)) {
-    if (!dirent.is_regular_file()) continue;
-    auto p = dirent.path();
-    if (p.extension() != ".csv") continue;  // only .csv
-
-    std::ifstream fin(p);
-    if (!fin) {
-      std::cerr << "Could not open: " << p << "\n";
-      continue;
+  std::size_t files_failed = 0;
+
+  // Per day-of-year range of the adjusted temperature over all rows, which
+  // plot_solar.cxx needs to normalize. Index 1..366.
+  const int MAX_DOY = 366;
+  std::vector<double> doy_min(MAX_DOY + 1,
+                              std::numeric_limits<double>::infinity());
+  std::vector<double> doy_max(MAX_DOY + 1,
+                              -std::numeric_limits<double>::infinity());
+  std::vector<Long64_t> doy_cnt(MAX_DOY + 1, 0);
+
+  // A window of 2 stations per thread keeps the threads busy when station
+  // sizes differ, while only that window of rows is held in memory
+  // The windows alternate between adjusting and filling, so each of the two
+  // phases is reported as its summed time from the first window on
+  const std::size_t window = 2 * static_cast<std::size_t>(threads);
+  StageReport::Phase adjust{"adjust", report.elapsed(), 0, 0, 0};
+  StageReport::Phase fill{"fill", report.elapsed(), 0, 0, 0};
+  for (std::size_t first = 0; first < files.size(); first += window) {
+    const std::size_t n = std::min(window, files.size() - first);
+    std::vector<StationRows> stations(n);
+    double t0 = report.elapsed();
+    parallelFor(n, threads, [&](std::size_t i) {
+      if (use_cache)
+        adjustCachedStation(files[first + i], filter, stations[i]);
+      else
+        adjustTextStation(files[first + i], stations[i]);
+    });
+    for (std::size_t i = 0; i < n; ++i) {
+      std::error_code ec;
+      const std::uintmax_t size = fs::file_size(files[first + i], ec);
+      if (!ec) adjust.bytes += size;
+      adjust.rows += stations[i].lines;
     }
-    ++files_processed;
-
-    std::string line;
-    std::size_t line_no = 0;
-    while (std::getline(fin, line)) {
-      ++line_no;
-      ++total_lines;
-      if (line.empty()) continue;
-
-      int year{0}, month{0}, day{0}, hour{0};
-      double tempC{0.0}, lat{0.0}, lon{0.0};
-      if (!parseLine(line, year, month, day, hour, tempC, lat, lon)) {
-        ++bad_lines;
+    adjust.wall_s += report.elapsed() - t0;
+
+    // Ordered merge into the tree
+    t0 = report.elapsed();
+    for (std::size_t i = 0; i < n; ++i) {
+      const StationRows& station = stations[i];
+      if (!station.error.empty()) {
+        std::cerr << station.error << "\n";
+        ++files_failed;
         continue;
       }
-
-      // Compute irradiances
-      double G0h =
-          toaHorizontalIrradiance_Wm2(year, month, day, hour, lon, lat);
-      double G0h_mean = meanToaIrradiance_Wm2_sameHour(year, hour, lon, lat);
-
-      // Correction and adjusted T
-      double correction = beta * (G0h - G0h_mean);
-      double T_adj = tempC - correction;
-
-      // Fill branches
-      b_year = year;
-      b_month = month;
-      b_day = day;
-      b_hour = hour;
-      b_lat = lat;
-      b_lon = lon;
-      b_temp_raw = tempC;
-      b_G0h = G0h;
-      b_G0h_mean = G0h_mean;
-      b_correction = correction;
-      b_temp_adj = T_adj;
-
-      tree->Fill();
+      b_station = static_cast<int>(station_names.size());
+      station_names.push_back(files[first + i].stem().string());
+      ++files_processed;
+      total_lines += station.lines;
+      bad_lines += station.bad_lines;
+      for (const AdjustedRow& row : station.rows) {
+        b = row;
+        tree->Fill();
+
+        const int J = dayOfYear(row.year, row.month, row.day);
+        if (J < 1) continue;
+        doy_min[J] = std::min(doy_min[J], row.temp_adj);
+        doy_max[J] = std::max(doy_max[J], row.temp_adj);
+        ++doy_cnt[J];
+      }
+      fill.rows += station.rows.size();
     }
+    fill.wall_s += report.elapsed() - t0;
   }
+  report.addRows(adjust.rows);
+  report.addBytes(adjust.bytes);
+  report.addPhase(adjust);
+  report.addPhase(fill);
 
+  ScopedPhase writePhase(report, "write");
   fout->cd();
   tree->Write();
 
+  // One entry per day of year that has data
+  TTree* summary = new TTree("doy_summary",
+                             "Adjusted temperature range per day of year");
+  int s_doy;
+  double s_min, s_max;
+  Long64_t s_count;
+  summary->Branch("doy", &s_doy, "doy/I");
+  summary->Branch("temp_adj_min_C", &s_min, "temp_adj_min_C/D");
+  summary->Branch("temp_adj_max_C", &s_max, "temp_adj_max_C/D");
+  summary->Branch("count", &s_count, "count/L");
+  for (int J = 1; J <= MAX_DOY; ++J) {
+    if (doy_cnt[J] == 0) continue;
+    s_doy = J;
+    s_min = doy_min[J];
+    s_max = doy_max[J];
+    s_count = doy_cnt[J];
+    summary->Fill();
+  }
+  summary->Write();
+
+  // Station names, entry i is station index i of the temps tree
+  TTree* station_list = new TTree("stations", "Stations of the temps tree");
+  int s_station;
+  char s_name[64];
+  station_list->Branch("station", &s_station, "station/I");
+  station_list->Branch("name", s_name, "name/C");
+  for (std::size_t i = 0; i < station_names.size(); ++i) {
+    s_station = static_cast<int>(i);
+    std::snprintf(s_name, sizeof s_name, "%s", station_names[i].c_str());
+    station_list->Fill();
+  }
+  station_list->Write();
+
   tree->Draw("temp_adj_C : (year + (month-1)/12.0 + (day-1)/365.2425)", "",
              "AP*");
 
   fout->Close();
+  writePhase.stop();
+  report.write();
 
-  std::cout << "Processed files: " << files_processed << "\n";
+  std::cout << "Processed files: " << files_processed << " (" << threads
+            << " threads)\n";
   std::cout << "Total lines:     " << total_lines << "\n";
   std::cout << "Bad lines:       " << bad_lines << "\n";
   std::cout << "Output ROOT:     " << out_file << "\n";
+  return files_failed == 0 ? 0 : 1;
 }
 
-void solar() { adjustTemps(); }
+int solar(unsigned threads = 0) { return adjustTemps(threads); }
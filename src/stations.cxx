@@ -0,0 +1,75 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "stations.h"
+
+// Usage:
+// g++ -O2 -Iinclude src/stations.cxx -o build/stations
+// ./build/stations [--near LAT,LON [-k N] | --box LAT0,LAT1,LON0,LON1 |
+//                   --band LAT0,LAT1] [--names] [--registry FILE]
+//
+// Queries the station registry written by build/clean (default
+// datasets/stations.csv) and prints the selected stations as
+// "station;latitude;longitude;first_year;last_year" lines, with the
+// distance in km for --near. Without a query every station is listed.
+// --names prints only the names, to hand a region to another tool:
+//   ./build/climate $(./build/stations --band 55,57 --names) --monthly
+
+int main(int argc, char* argv[]) {
+  StationSelection selection;
+  std::string registry = "datasets/stations.csv";
+  std::string error;
+  bool names_only = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--names") {
+      names_only = true;
+    } else if (arg == "--registry" && i + 1 < argc) {
+      registry = argv[++i];
+    } else if (!selection.parseArg(i, argc, argv, error) || !error.empty()) {
+      if (!error.empty()) std::cerr << error << "\n";
+      std::cerr << "Usage: " << argv[0] << " " << StationSelection::kUsage
+                << " [--names] [--registry FILE]" << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<StationInfo> stations;
+  if (!readStationRegistry(registry, stations)) {
+    std::cerr << "Cannot read the station registry " << registry << "\n";
+    return 1;
+  }
+  const StationIndex index(stations);
+
+  std::vector<std::size_t> selected;
+  std::vector<double> distance;
+  if (selection.kind() == StationSelection::Kind::Near) {
+    const double* v = selection.values();
+    for (const auto& n : index.nearest(v[0], v[1], selection.k())) {
+      selected.push_back(n.index);
+      distance.push_back(n.distance_km);
+    }
+  } else if (selection.active()) {
+    selected = selection.select(index);
+  } else {
+    for (std::size_t i = 0; i < stations.size(); ++i) selected.push_back(i);
+  }
+
+  if (!names_only) {
+    std::cout << "station;latitude;longitude;first_year;last_year"
+              << (distance.empty() ? "" : ";distance_km") << "\n";
+  }
+  for (std::size_t j = 0; j < selected.size(); ++j) {
+    const StationInfo& s = stations[selected[j]];
+    if (names_only) {
+      std::cout << s.name << "\n";
+      continue;
+    }
+    std::cout << s.name << ";" << s.latitude << ";" << s.longitude << ";"
+              << s.first_year << ";" << s.last_year;
+    if (!distance.empty()) std::cout << ";" << distance[j];
+    std::cout << "\n";
+  }
+  return 0;
+}
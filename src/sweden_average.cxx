@@ -1,79 +1,393 @@
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <vector>
 #include <string>
 #include <map>
 #include <filesystem>
+#include <algorithm>
+#include <cmath>
+
+#include "instrument.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "parse_utils.h"
+#include "rolling.h"
+#include "station_cache.h"
+#include "stations.h"
+
+// Usage:
+// ./build/sweden_average [--weight station|latitude] [--band-width DEG] [-j N]
+//                        [--near LAT,LON [-k N] | --box LAT0,LAT1,LON0,LON1 |
+//                         --band LAT0,LAT1] [--out FILE]
+//                        [--smooth YEARS [--trailing] [--smooth-dir DIR]]
+//
+// Averages the yearly station summaries in datasets/Climate (year;max;min;mean)
+// into datasets/Climate/Sweden.csv. Stations are parsed in parallel, each
+// thread into its own dense array indexed by year, and the arrays are merged
+// pairwise in a tree reduction.
+//
+// --near, --box and --band average a region instead: the stations are
+// looked up in the registry datasets/stations.csv (see stations.h) and only
+// their files are read. The result goes to --out, by default
+// datasets/regions/region.csv, outside datasets/Climate so that it is not
+// taken for a station.
+//
+// --weight station   every station counts the same (default)
+// --weight latitude  stations are grouped in latitude bands of --band-width
+//                    degrees (default 1) and every band counts the same, so
+//                    the densely measured south does not dominate the average
+//
+// --smooth YEARS also writes running means over windows of YEARS years,
+// centred on each year unless --trailing, for the average and for every
+// station read, in the same run: DIR/<name of --out> and
+// DIR/stations/<city>.csv, DIR being datasets/smoothed unless --smooth-dir.
+// Their rows are year;max;min;mean;mean_sd;mean_min;mean_max;years, the
+// running means of the three columns, the spread of the yearly means in
+// the window and the number of years with data in it. A year is written
+// when at least half of its window has data (rolling.h).
 
 namespace fs = std::filesystem;
 
+// Years covered by the dense arrays, rows outside are ignored
+constexpr int kFirstYear = 1700;
+constexpr int kLastYear = 2100;
+constexpr int kYears = kLastYear - kFirstYear + 1;
+
 struct YearData {
     double max_sum = 0;
     double min_sum = 0;
     double mean_sum = 0;
-    int count = 0;
+    double weight = 0;
+};
+
+using YearTable = std::vector<YearData>;
+
+enum class Weighting { Station, Latitude };
+
+struct Station {
+    fs::path file;
+    std::string city;
+    double weight = 1;
 };
 
-int main() {
-    std::string folder = "datasets/Climate"; 
-    std::map<int, YearData> averages;
+// Adds one station's yearly file into `table`, every year with weight w.
+// Lines that do not parse (e.g. a header) are skipped. Returns the number of
+// years added; the file size is added to `bytes`.
+static long addStation(const Station &station, YearTable &table, std::uint64_t &bytes) {
+    MappedFile file(station.file.string());
+    if (!file.is_open()) {
+        std::cerr << "Cannot open " << station.file << std::endl;
+        return 0;
+    }
+    bytes += file.size();
+    long rows = 0;
+
+    const double w = station.weight;
+    std::string_view f[4];
+    forEachLine(file.view(), [&](std::string_view line) {
+        int year;
+        double max_temp, min_temp, mean_temp;
+        if (splitFields(line, ';', f, 4) != 4 || !parseInt(f[0], year) ||
+            !parseDouble(f[1], max_temp) || !parseDouble(f[2], min_temp) ||
+            !parseDouble(f[3], mean_temp))
+            return;
+        if (year < kFirstYear || year > kLastYear) return;
+
+        YearData &data = table[year - kFirstYear];
+        data.max_sum += w * max_temp;
+        data.min_sum += w * min_temp;
+        data.mean_sum += w * mean_temp;
+        data.weight += w;
+        ++rows;
+    });
+    return rows;
+}
+
+static void mergeInto(YearTable &into, const YearTable &from) {
+    for (int i = 0; i < kYears; ++i) {
+        into[i].max_sum += from[i].max_sum;
+        into[i].min_sum += from[i].min_sum;
+        into[i].mean_sum += from[i].mean_sum;
+        into[i].weight += from[i].weight;
+    }
+}
+
+// The yearly averages in `table` as a series, NaN where it has no data,
+// and the first and last year with data (last < first if none)
+static void tableSeries(const YearTable &table, std::vector<double> series[3],
+                        int &first, int &last) {
+    first = kYears;
+    last = -1;
+    for (int c = 0; c < 3; ++c) series[c].assign(kYears, std::nan(""));
+    for (int i = 0; i < kYears; ++i) {
+        const YearData &data = table[i];
+        if (data.weight <= 0) continue;
+        series[0][i] = data.max_sum / data.weight;
+        series[1][i] = data.min_sum / data.weight;
+        series[2][i] = data.mean_sum / data.weight;
+        first = std::min(first, i);
+        last = i;
+    }
+}
+
+// Writes the running statistics of `table` to `file`, see --smooth
+static bool writeSmoothed(const YearTable &table, const RollingOptions &options,
+                          const fs::path &file) {
+    std::vector<double> series[3];
+    int first, last;
+    tableSeries(table, series, first, last);
+    std::vector<RollingStats> smooth[3];
+    for (int c = 0; c < 3; ++c) smooth[c] = rolling(series[c], options);
+
+    std::ofstream fout(file);
+    if (!fout.is_open()) {
+        std::cerr << "Could not write " << file << std::endl;
+        return false;
+    }
+    for (int i = first; i <= last; ++i) {
+        const RollingStats &mean = smooth[2][i];
+        if (!mean.valid()) continue;
+        fout << kFirstYear + i << ";" << smooth[0][i].mean << ";"
+             << smooth[1][i].mean << ";" << mean.mean << ";"
+             << (mean.count > 1 ? mean.sd() : 0) << ";" << mean.min << ";"
+             << mean.max << ";" << mean.count << "\n";
+    }
+    return true;
+}
+
+// Station latitude from the registry, the columnar cache, or the first row
+// of the cleaned file (year;month;day;hour;temperature;lat;lon). NaN if
+// unknown.
+static double stationLatitude(const std::string &city,
+                              const std::map<std::string, double> &registry) {
+    auto known = registry.find(city);
+    if (known != registry.end()) return known->second;
+
+    StationCache cache(stationCachePath("datasets/cache", city));
+    if (cache.is_open()) return cache.view().latitude;
 
-    // Loop over all CSV files in the folder
-    for (const auto& entry : fs::directory_iterator(folder)) {
-        if (entry.path().extension() != ".csv") continue;
+    std::ifstream fin("datasets/clean/" + city + ".csv");
+    std::string line;
+    std::string_view f[7];
+    double lat;
+    if (std::getline(fin, line) && splitFields(line, ';', f, 7) == 7 &&
+        parseDouble(f[5], lat))
+        return lat;
+    return std::nan("");
+}
+
+// Gives every station 1 / (number of stations in its latitude band)
+static void weightByLatitude(std::vector<Station> &stations, double bandWidth) {
+    std::map<std::string, double> registry;
+    std::vector<StationInfo> infos;
+    if (readStationRegistry("datasets/stations.csv", infos))
+        for (const StationInfo &info : infos) registry[info.name] = info.latitude;
+
+    std::map<long, int> perBand;
+    std::vector<long> band(stations.size());
+    for (std::size_t i = 0; i < stations.size(); ++i) {
+        double lat = stationLatitude(stations[i].city, registry);
+        if (std::isnan(lat)) {
+            std::cerr << "No latitude for " << stations[i].city
+                      << ", giving it a band of its own" << std::endl;
+            band[i] = -1000000 - static_cast<long>(i);
+        } else {
+            band[i] = static_cast<long>(std::floor(lat / bandWidth));
+        }
+        ++perBand[band[i]];
+    }
+    for (std::size_t i = 0; i < stations.size(); ++i)
+        stations[i].weight = 1.0 / perBand[band[i]];
+    std::cout << stations.size() << " stations in " << perBand.size()
+              << " latitude bands of " << bandWidth << " degrees\n";
+}
+
+int swedenAverageMain(int argc, char* argv[]) {
+    StageReport report("sweden_average");
+    std::string folder = "datasets/Climate";
+    Weighting weighting = Weighting::Station;
+    double bandWidth = 1.0;
+    unsigned threads = defaultThreads();
+    StationSelection selection;
+    std::string outFile;
+    RollingOptions smoothing;
+    smoothing.window = 0;  // no smoothing
+    std::string smoothDir = "datasets/smoothed";
+    std::string error;
+
+    auto usage = [&]() {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--weight station|latitude] [--band-width DEG] [-j N] "
+                  << StationSelection::kUsage << " [--out FILE]"
+                  << " [--smooth YEARS [--trailing] [--smooth-dir DIR]]"
+                  << std::endl;
+        return 1;
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--weight" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "station") weighting = Weighting::Station;
+            else if (mode == "latitude") weighting = Weighting::Latitude;
+            else {
+                std::cerr << "Unknown weighting " << mode << std::endl;
+                return 1;
+            }
+        } else if (arg == "--band-width" && i + 1 < argc) {
+            if (!parseDouble(argv[++i], bandWidth) || !(bandWidth > 0)) {
+                std::cerr << "Bad band width " << argv[i] << std::endl;
+                return usage();
+            }
+        } else if (arg == "-j" && i + 1 < argc) {
+            threads = parseThreads(argv[++i]);
+        } else if (arg == "--out" && i + 1 < argc) {
+            outFile = argv[++i];
+        } else if (arg == "--smooth" && i + 1 < argc) {
+            int years;
+            if (!parseInt(argv[++i], years) || years < 1) {
+                std::cerr << "Bad smoothing window " << argv[i] << std::endl;
+                return 1;
+            }
+            smoothing.window = years;
+        } else if (arg == "--trailing") {
+            smoothing.align = Alignment::Trailing;
+        } else if (arg == "--smooth-dir" && i + 1 < argc) {
+            smoothDir = argv[++i];
+        } else if (!selection.parseArg(i, argc, argv, error) || !error.empty()) {
+            if (!error.empty()) std::cerr << error << std::endl;
+            return usage();
+        }
+    }
+    if (outFile.empty())
+        outFile = selection.active() ? "datasets/regions/region.csv"
+                                     : "datasets/Climate/Sweden.csv";
 
-        std::ifstream fin(entry.path());
-        if (!fin.is_open()) {
-            std::cerr << "Cannot open " << entry.path() << std::endl;
-            continue;
+    std::vector<Station> stations;
+    if (selection.active()) {
+        // Only the files of the selected stations; a station without a
+        // yearly file (e.g. one left out of the analysis) is skipped
+        std::vector<std::string> names;
+        if (!selection.selectNames("datasets/stations.csv", names, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        for (const std::string &name : names) {
+            fs::path file = fs::path(folder) / (name + ".csv");
+            if (fs::exists(file)) stations.push_back({file, name});
         }
+        std::cout << "Selected " << stations.size() << " of " << names.size()
+                  << " stations from the registry\n";
+    } else {
+        // Collect all station CSV files in the folder
+        for (const auto& entry : fs::directory_iterator(folder)) {
+            if (entry.path().extension() != ".csv") continue;
+            // Our own output from an earlier run
+            if (entry.path().filename() == "Sweden.csv") continue;
+            stations.push_back({entry.path(), entry.path().stem().string()});
+        }
+    }
+    std::sort(stations.begin(), stations.end(),
+              [](const Station &a, const Station &b) { return a.file < b.file; });
+
+    if (weighting == Weighting::Latitude) weightByLatitude(stations, bandWidth);
 
-        std::string line;
-        std::getline(fin, line); // skip header
-
-        while (std::getline(fin, line)) {
-            std::stringstream ss(line);
-            std::string year_str, max_str, min_str, mean_str;
-
-            if (!std::getline(ss, year_str, ';')) continue;
-            if (!std::getline(ss, max_str, ';')) continue;
-            if (!std::getline(ss, min_str, ';')) continue;
-            if (!std::getline(ss, mean_str, ';')) continue;
-
-            try {
-                int year = std::stoi(year_str);
-                double max_temp = std::stod(max_str);
-                double min_temp = std::stod(min_str);
-                double mean_temp = std::stod(mean_str);
-
-                averages[year].max_sum += max_temp;
-                averages[year].min_sum += min_temp;
-                averages[year].mean_sum += mean_temp;
-                averages[year].count += 1;
-            } catch (...) {
-                // skip malformed lines
-                continue;
+    // Each thread parses a contiguous slice of the stations into its own table
+    const unsigned nThreads = std::max<std::size_t>(
+        1, std::min<std::size_t>(threads, stations.size()));
+    // With --smooth every station is also kept in a table of its own
+    const bool smooth = smoothing.window > 0;
+    std::vector<YearTable> tables(nThreads, YearTable(kYears));
+    std::vector<YearTable> stationTables(smooth ? stations.size() : 0);
+    {
+        ScopedPhase phase(report, "parse");
+        std::vector<long> rows(nThreads, 0);
+        std::vector<std::uint64_t> bytes(nThreads, 0);
+        parallelFor(nThreads, nThreads, [&](std::size_t t) {
+            std::size_t begin = stations.size() * t / nThreads;
+            std::size_t end = stations.size() * (t + 1) / nThreads;
+            for (std::size_t i = begin; i < end; ++i) {
+                if (!smooth) {
+                    rows[t] += addStation(stations[i], tables[t], bytes[t]);
+                    continue;
+                }
+                stationTables[i].resize(kYears);
+                rows[t] += addStation(stations[i], stationTables[i], bytes[t]);
+                mergeInto(tables[t], stationTables[i]);
             }
+        });
+        for (unsigned t = 0; t < nThreads; ++t) {
+            phase.addRows(rows[t]);
+            phase.addBytes(bytes[t]);
         }
+    }
 
-        fin.close();
+    // Tree reduction: merge tables pairwise until the result is in tables[0]
+    {
+        ScopedPhase phase(report, "merge");
+        for (std::size_t stride = 1; stride < tables.size(); stride *= 2) {
+            std::size_t pairs = (tables.size() + 2 * stride - 1) / (2 * stride);
+            parallelFor(pairs, nThreads, [&](std::size_t p) {
+                std::size_t left = p * 2 * stride;
+                if (left + stride < tables.size()) mergeInto(tables[left], tables[left + stride]);
+            });
+        }
     }
+    const YearTable &averages = tables[0];
 
     // Write averaged CSV
-    std::ofstream fout("datasets/Climate/Sweden.csv");
-    
+    ScopedPhase writePhase(report, "write");
+    if (fs::path(outFile).has_parent_path())
+        fs::create_directories(fs::path(outFile).parent_path());
+    std::ofstream fout(outFile);
+    if (!fout.is_open()) {
+        std::cerr << "Could not write " << outFile << std::endl;
+        return 1;
+    }
 
-    for (const auto& [year, data] : averages) {
-        if (data.count == 0) continue;
-        double avg_max = data.max_sum / data.count;
-        double avg_min = data.min_sum / data.count;
-        double avg_mean = data.mean_sum / data.count;
-        
+    for (int i = 0; i < kYears; ++i) {
+        const YearData &data = averages[i];
+        if (data.weight <= 0) continue;
+        double avg_max = data.max_sum / data.weight;
+        double avg_min = data.min_sum / data.weight;
+        double avg_mean = data.mean_sum / data.weight;
 
-        fout << year << ";" << avg_max << ";" << avg_min <<  ";" << avg_mean << "\n";
+        fout << kFirstYear + i << ";" << avg_max << ";" << avg_min <<  ";" << avg_mean << "\n";
     }
 
     fout.close();
-    std::cout << "Averaged CSV saved to Sweden.csv\n";
+    writePhase.stop();
+    std::cout << "Averaged " << stations.size() << " stations with " << nThreads
+              << " threads, CSV saved to " << outFile << "\n";
+
+    // Running means of the average and of every station, one pass over each
+    // series, the stations in parallel
+    bool ok = true;
+    if (smooth) {
+        ScopedPhase phase(report, "smooth");
+        const fs::path dir = fs::path(smoothDir) / "stations";
+        std::error_code ec;
+        fs::create_directories(dir, ec);  // a failure shows in the writes
+        const fs::path averageFile =
+            fs::path(smoothDir) / fs::path(outFile).filename();
+        ok = writeSmoothed(averages, smoothing, averageFile);
+        std::vector<char> written(stations.size(), 0);
+        parallelFor(stations.size(), threads, [&](std::size_t i) {
+            written[i] = writeSmoothed(stationTables[i], smoothing,
+                                       dir / (stations[i].city + ".csv"));
+        });
+        for (char w : written) ok = ok && w;
+        phase.addRows(static_cast<std::uint64_t>(stations.size() + 1) * kYears);
+        if (ok)
+            std::cout << smoothing.window << "-year running means saved to "
+                      << averageFile.string() << " and " << dir.string()
+                      << "\n";
+    }
+    // The report of the phases that ran, also when a file failed
+    report.write();
+    return ok ? 0 : 1;
 }
+
+#ifndef PIPELINE_DRIVER
+int main(int argc, char* argv[]) { return swedenAverageMain(argc, argv); }
+#endif
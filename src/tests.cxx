@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "solar.h"
+#include "spectral.h"
+#include "trend.h"
+
+// Usage:
+// g++ -O2 -Iinclude src/tests.cxx -o build/tests
+// ./build/tests
+//
+// Consistency checks of the shared numerics that have a second way to get
+// the same answer, run by preprocess.sh after the tools are built:
+//
+//   solar/batch       toaHorizontalIrradianceBatch against
+//                     toaIrradianceOnDay_Wm2 on random days and positions
+//   solar/table       IrradianceTable against toaHorizontalIrradiance_Wm2
+//                     and meanToaIrradiance_Wm2_sameHour
+//   trend/ranged      the ranged TREND fit of the query server against
+//                     ordinary least squares written out
+//   spectral/welch    a Welch spectrum of a series shorter than its segment
+//
+// Prints one line per check and exits with a failure if any of them fails.
+// Timings are build/benchmark's job.
+
+// Largest relative difference between two fits that should be the same
+constexpr double kTrendTolerance = 1e-9;
+
+static bool report(const std::string& name, bool passed,
+                   const std::string& detail) {
+  std::cout << (passed ? "ok    " : "FAIL  ") << name << ": " << detail
+            << "\n";
+  return passed;
+}
+
+// The arguments streamed into one string
+template <typename... Args>
+static std::string text(const Args&... args) {
+  std::ostringstream out;
+  (out << ... << args);
+  return out.str();
+}
+
+static double relative(double p, double q) {
+  return std::abs(p - q) /
+         std::max(1e-300, std::max(std::abs(p), std::abs(q)));
+}
+
+static bool batchKernel() {
+  const std::size_t n = 100000;
+  std::mt19937 rng(12345);
+  std::uniform_int_distribution<int> day(1, 366), hour(0, 23);
+  std::uniform_real_distribution<double> lat(55.3, 69.1), lon(11.0, 24.2);
+  std::vector<int> doy(n), hours(n);
+  std::vector<double> lons(n), lats(n), batch(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    doy[i] = day(rng);
+    hours[i] = hour(rng);
+    lons[i] = lon(rng);
+    lats[i] = lat(rng);
+  }
+  toaHorizontalIrradianceBatch(doy.data(), hours.data(), lons.data(),
+                               lats.data(), batch.data(), n);
+  double max_diff = 0;
+  for (std::size_t i = 0; i < n; ++i)
+    max_diff = std::max(
+        max_diff, std::abs(batch[i] - toaIrradianceOnDay_Wm2(
+                                          doy[i], hours[i], lons[i], lats[i])));
+  return report("solar/batch", max_diff <= kBatchIrradianceTolerance_Wm2,
+                text("max |scalar - batch| ", max_diff, " W/m^2 over ", n,
+                     " rows"));
+}
+
+static bool irradianceTable() {
+  double max_diff = 0;
+  for (double lat : {55.4, 59.3, 67.8}) {
+    for (double lon : {11.9, 18.1, 20.2}) {
+      const IrradianceTable table(lon, lat);
+      for (int year : {1999, 2000}) {
+        for (int J = 1; J <= (isLeap(year) ? 366 : 365); ++J) {
+          for (int hour = 0; hour < 24; ++hour)
+            max_diff = std::max(
+                max_diff, std::abs(table.irradiance(year, 1, J, hour) -
+                                   toaHorizontalIrradiance_Wm2(
+                                       year, 1, J, hour, lon, lat)));
+        }
+        for (int hour = 0; hour < 24; ++hour)
+          max_diff = std::max(
+              max_diff, std::abs(table.mean(year, hour) -
+                                 meanToaIrradiance_Wm2_sameHour(year, hour,
+                                                                lon, lat)));
+      }
+    }
+  }
+  return report("solar/table", max_diff <= kBatchIrradianceTolerance_Wm2,
+                text("max difference ", max_diff, " W/m^2"));
+}
+
+// Yearly means with a trend of 1 degree per century and noise
+static bool rangedTrend() {
+  std::mt19937 rng(12345);
+  std::normal_distribution<double> noise(0.0, 0.6);
+  std::vector<double> x, y;
+  TrendAccumulator ranged;
+  for (int year = 1910; year <= 2024; ++year) {
+    x.push_back(year);
+    y.push_back(6.0 + 0.01 * (year - 1910) + noise(rng));
+    ranged.add(x.back(), y.back(), 1.0);
+  }
+  const TrendFit a = ranged.fitToScatter();
+
+  // Slope Sxy / Sxx, slope error sqrt(s^2 / Sxx)
+  const double m = static_cast<double>(x.size());
+  double mx = 0, my = 0;
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    mx += x[i] / m;
+    my += y[i] / m;
+  }
+  double sxx = 0, sxy = 0;
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    sxx += (x[i] - mx) * (x[i] - mx);
+    sxy += (x[i] - mx) * (y[i] - my);
+  }
+  const double slope = sxy / sxx;
+  double rss = 0;
+  for (std::size_t i = 0; i < x.size(); ++i) {
+    const double r = y[i] - my - slope * (x[i] - mx);
+    rss += r * r;
+  }
+  const double slope_error = std::sqrt(rss / (m - 2) / sxx);
+  const double diff = std::max(relative(a.slope, slope),
+                               relative(a.slope_error, slope_error));
+  return report("trend/ranged", a.ok && diff <= kTrendTolerance,
+                text("relative difference to least squares ", diff, " over ",
+                     x.size(), " years"));
+}
+
+// A monthly series shorter than the Welch segment still has a spectrum,
+// from one segment of the largest power of two that fits
+static bool shortWelch() {
+  std::vector<double> monthly(200);
+  for (std::size_t i = 0; i < monthly.size(); ++i)
+    monthly[i] =
+        8.0 - 9.0 * std::cos(2 * PI * i / 12.0) + 0.5 * std::sin(0.7 * i);
+  const Spectrum welch = welchPeriodogram(monthly, 12.0, 256);
+  return report("spectral/welch", welch.power.size() == 65,
+                text(welch.power.size(), " frequencies of ", monthly.size(),
+                     " months with 256-month segments (expected 65)"));
+}
+
+int main() {
+  bool ok = true;
+  ok &= batchKernel();
+  ok &= irradianceTable();
+  ok &= rangedTrend();
+  ok &= shortWelch();
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "parallel.h"
+#include "parse_utils.h"
+#include "trend.h"
+
+// Usage:
+// ./build/trends [-j N] [--out FILE]
+//
+// Fits the linear trend of the yearly mean, max and min temperature of
+// every station in datasets/Climate (year;max;min;mean, Sweden.csv
+// included) in one batch and writes datasets/trends.csv as
+// "station;metric;slope;slope_error;intercept;intercept_error;points",
+// slopes in degrees per century. The years are binned and fitted as in the
+// trend plots (see trend.h), so the numbers are the ones in their legends.
+
+namespace fs = std::filesystem;
+
+enum Metric { Mean, Max, Min, kMetrics };
+static const char* kMetricName[kMetrics] = {"mean", "max", "min"};
+
+struct StationTrends {
+  std::string city;
+  TrendFit fit[kMetrics];
+  bool read = false;
+};
+
+static void fitStation(const fs::path& file, StationTrends& out) {
+  MappedFile input(file.string());
+  if (!input.is_open()) return;
+  out.read = true;
+
+  YearProfile profile[kMetrics];
+  std::string_view f[4];
+  forEachLine(input.view(), [&](std::string_view line) {
+    int year;
+    double max_temp, min_temp, mean_temp;
+    if (splitFields(line, ';', f, 4) != 4 || !parseInt(f[0], year) ||
+        !parseDouble(f[1], max_temp) || !parseDouble(f[2], min_temp) ||
+        !parseDouble(f[3], mean_temp))
+      return;
+    profile[Mean].add(year, mean_temp);
+    profile[Max].add(year, max_temp);
+    profile[Min].add(year, min_temp);
+  });
+  for (int m = 0; m < kMetrics; ++m) out.fit[m] = profile[m].fit();
+}
+
+int trendsMain(int argc, char* argv[]) {
+  const fs::path folder = "datasets/Climate";
+  fs::path out_file = "datasets/trends.csv";
+  unsigned threads = defaultThreads();
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc) {
+      threads = parseThreads(argv[++i]);
+    } else if (arg == "--out" && i + 1 < argc) {
+      out_file = argv[++i];
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [-j N] [--out FILE]" << std::endl;
+      return 1;
+    }
+  }
+  if (!fs::is_directory(folder)) {
+    std::cerr << "Input directory not found: " << folder << "\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<fs::path> files;
+  for (const auto& entry : fs::directory_iterator(folder))
+    if (entry.path().extension() == ".csv") files.push_back(entry.path());
+  std::sort(files.begin(), files.end());
+
+  std::vector<StationTrends> stations(files.size());
+  parallelFor(files.size(), threads, [&](std::size_t i) {
+    stations[i].city = files[i].stem().string();
+    fitStation(files[i], stations[i]);
+  });
+
+  std::ofstream out(out_file);
+  if (!out.is_open()) {
+    std::cerr << "Could not open " << out_file << "\n";
+    return 1;
+  }
+  out << "station;metric;slope;slope_error;intercept;intercept_error;points\n";
+  int fitted = 0;
+  for (const StationTrends& s : stations) {
+    if (!s.read) {
+      std::cerr << "Could not open " << s.city << ".csv\n";
+      continue;
+    }
+    for (int m = 0; m < kMetrics; ++m) {
+      const TrendFit& t = s.fit[m];
+      if (!t.ok) continue;
+      out << s.city << ";" << kMetricName[m] << ";" << 100 * t.slope << ";"
+          << 100 * t.slope_error << ";" << t.intercept << ";"
+          << t.intercept_error << ";" << t.points << "\n";
+      ++fitted;
+    }
+  }
+
+  std::chrono::duration<double, std::milli> ms =
+      std::chrono::steady_clock::now() - start;
+  std::cout << fitted << " trends of " << stations.size() << " stations in "
+            << ms.count() << " ms, written to " << out_file << "\n";
+  return 0;
+}
+
+#ifndef PIPELINE_DRIVER
+int main(int argc, char* argv[]) { return trendsMain(argc, argv); }
+#endif